@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+# Compares the results of naplua_bench runs, for example of builds with different Lua backends.
+# Usage: compare_results.py baseline.json other.json [...]
+
+import json
+import sys
+
+
+def load(path):
+    with open(path) as file:
+        results = json.load(file)
+    # Failed benchmarks have no valid times, they show up as missing.
+    return results["lua"], {result["name"]: result["ns_per_op"] for result in results["results"] if not result.get("failed", False)}
+
+
+def main(paths):
+    if len(paths) < 2:
+        print("Usage: compare_results.py baseline.json other.json [...]")
+        return 1
+
+    runs = [load(path) for path in paths]
+    baseline_name, baseline = runs[0]
+    names = list(baseline)
+    for _, results in runs[1:]:
+        names += [name for name in results if name not in names]
+
+    # Time per operation of every run, and its speedup relative to the first run.
+    header = "{:<60}{:>16}".format("benchmark (ns/op)", baseline_name[:15])
+    for lua, _ in runs[1:]:
+        header += "{:>16}{:>9}".format(lua[:15], "speedup")
+    print(header)
+    for name in names:
+        line = "{:<60}{:>16}".format(name[:59], "{:.1f}".format(baseline[name]) if name in baseline else "-")
+        for _, results in runs[1:]:
+            if name not in results:
+                line += "{:>16}{:>9}".format("-", "")
+                continue
+            speedup = "{:.2f}x".format(baseline[name] / results[name]) if name in baseline and results[name] > 0 else ""
+            line += "{:>16}{:>9}".format("{:.1f}".format(results[name]), speedup)
+        print(line)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,482 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// Headless benchmarks of the naplua binding layer, results are written as JSON.
+// Usage: naplua_bench [output.json]
+//        naplua_bench --script <script.lua> <function>
+// The second form repeatedly calls a function of another script, which is used to train profile guided optimisation on real scripts.
+
+#include <LuaScript.h>
+
+#include <utility/stringutils.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	/**
+	 * Result of a single benchmark.
+	 */
+	struct Result
+	{
+		std::string mName;
+		int mIterations = 0;
+		double mNanosecondsPerOp = 0.0;		///< Median of the repetitions
+		double mP50 = 0.0;					///< Only set for distributions, in nanoseconds
+		double mP99 = 0.0;
+		double mMax = 0.0;
+		bool mFailed = false;				///< Whether a call failed, the times are not valid
+		std::string mError;					///< The error of the call that failed
+	};
+
+	std::vector<Result> sResults;
+	bool sFailed = false;
+
+
+	/**
+	 * Writes a line of progress or an error to stderr, stdout is reserved for the JSON results.
+	 */
+	template <typename... Args>
+	void report(const char* format, Args... args)
+	{
+		std::fprintf(stderr, format, args...);
+		std::fputc('\n', stderr);
+	}
+
+
+	/**
+	 * Stores a benchmark that failed, the run exits with an error once the results are written.
+	 */
+	void fail(const std::string& name, const nap::utility::ErrorState& errorState)
+	{
+		Result result;
+		result.mName = name;
+		result.mFailed = true;
+		result.mError = errorState.toString();
+		sResults.emplace_back(result);
+		sFailed = true;
+		report("%-40s failed: %s", name.c_str(), result.mError.c_str());
+	}
+
+
+	/**
+	 * Runs 'function' 'iterations' times per repetition and stores the median time per iteration.
+	 * The benchmark is stored as failed when a call of the function fails.
+	 */
+	void measure(const std::string& name, int iterations, const std::function<bool(nap::utility::ErrorState&)>& function)
+	{
+		constexpr int repetitions = 7;
+		nap::utility::ErrorState error_state;
+
+		// Warm up caches and lazily created state.
+		for (int i = 0; i < std::max(iterations / 10, 1); i++)
+		{
+			if (!function(error_state))
+			{
+				fail(name, error_state);
+				return;
+			}
+		}
+
+		std::vector<double> times;
+		for (int r = 0; r < repetitions; r++)
+		{
+			auto start = Clock::now();
+			for (int i = 0; i < iterations; i++)
+			{
+				if (!function(error_state))
+				{
+					fail(name, error_state);
+					return;
+				}
+			}
+			times.emplace_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations);
+		}
+		std::sort(times.begin(), times.end());
+
+		Result result;
+		result.mName = name;
+		result.mIterations = iterations;
+		result.mNanosecondsPerOp = times[repetitions / 2];
+		sResults.emplace_back(result);
+		report("%-40s %12.1f ns/op", name.c_str(), result.mNanosecondsPerOp);
+	}
+
+
+	/**
+	 * Stores the latency distribution recorded by the call statistics of a script.
+	 */
+	void storeDistribution(const std::string& name, const nap::LuaCallStats::Summary& summary)
+	{
+		Result result;
+		result.mName = name;
+		result.mIterations = static_cast<int>(summary.mCount);
+		result.mNanosecondsPerOp = summary.mMean * 1e9;
+		result.mP50 = summary.mP50 * 1e9;
+		result.mP99 = summary.mP99 * 1e9;
+		result.mMax = summary.mMax * 1e9;
+		sResults.emplace_back(result);
+		report("%-40s p50 %10.1f ns, p99 %10.1f ns, max %10.1f ns", name.c_str(), result.mP50, result.mP99, result.mMax);
+	}
+
+
+	// Binds glm::vec3 the same way the README does.
+	struct VecHelper
+	{
+		template <unsigned index>
+		static float get(glm::vec3 const* vec) { return (*vec)[index]; }
+
+		template <unsigned index>
+		static void set(glm::vec3* vec, float value) { (*vec)[index] = value; }
+
+		static glm::vec3 add(const glm::vec3& l, const glm::vec3& r) { return l + r; }
+	};
+
+
+	void bindVec3(nap::LuaScript& script)
+	{
+		script.getNamespace().beginClass<glm::vec3>("vec3")
+			.addConstructor<void(*)(float, float, float)>()
+			.addProperty("x", &VecHelper::get<0>, &VecHelper::set<0>)
+			.addProperty("y", &VecHelper::get<1>, &VecHelper::set<1>)
+			.addProperty("z", &VecHelper::get<2>, &VecHelper::set<2>)
+			.addFunction("__add", &VecHelper::add)
+			.endClass();
+	}
+
+
+	void benchmarkCalls(nap::LuaScript& script)
+	{
+		double a = 1.0, b = 2.0, c = 3.0;
+		double number_result = 0.0;
+		std::string text = "naplua", text_result;
+
+		measure("callVoid/0 args", 100000, [&](nap::utility::ErrorState& e) { return script.callVoid("noArgs", e); });
+		measure("callVoid/1 number", 100000, [&](nap::utility::ErrorState& e) { return script.callVoid("oneNumber", e, a); });
+		measure("callVoid/3 numbers", 100000, [&](nap::utility::ErrorState& e) { return script.callVoid("threeNumbers", e, a, b, c); });
+		measure("call/2 numbers -> number", 100000, [&](nap::utility::ErrorState& e) { return script.call("add", e, number_result, a, b); });
+		measure("call/string -> string", 100000, [&](nap::utility::ErrorState& e) { return script.call("echoString", e, text_result, text); });
+	}
+
+
+	void benchmarkVariables(nap::LuaScript& script)
+	{
+		int int_value = 0;
+		float float_value = 0.0f;
+		std::string string_value;
+
+		measure("getVariable/int", 100000, [&](nap::utility::ErrorState& e) { return script.getVariable("intValue", e, int_value); });
+		measure("getVariable/float", 100000, [&](nap::utility::ErrorState& e) { return script.getVariable("floatValue", e, float_value); });
+		measure("getVariable/string", 100000, [&](nap::utility::ErrorState& e) { return script.getVariable("stringValue", e, string_value); });
+	}
+
+
+	void benchmarkUserdata(nap::LuaScript& script)
+	{
+		double count = 1000;
+		glm::vec3 l(1.0f), r(2.0f), result;
+
+		measure("vec3/create in Lua (x1000)", 1000, [&](nap::utility::ErrorState& e) { return script.callVoid("createVectors", e, count); });
+		measure("vec3/pass 2, return 1", 100000, [&](nap::utility::ErrorState& e) { return script.call("addVectors", e, result, l, r); });
+	}
+
+
+	void benchmarkTables(nap::LuaScript& script)
+	{
+		for (int size : { 16, 256, 4096 })
+		{
+			std::vector<float> values(size, 1.0f);
+			double sum = 0.0;
+			measure(nap::utility::stringFormat("vector<float>/to Lua (%d)", size), 100000 / size + 10, [&](nap::utility::ErrorState& e) { return script.call("sumArray", e, sum, values); });
+
+			double count = size;
+			std::vector<float> returned;
+			measure(nap::utility::stringFormat("vector<float>/from Lua (%d)", size), 100000 / size + 10, [&](nap::utility::ErrorState& e) { return script.call("makeArray", e, returned, count); });
+
+			std::map<std::string, float> map;
+			for (int i = 0; i < size; i++)
+				map[std::to_string(i)] = 1.0f;
+			measure(nap::utility::stringFormat("map<string, float>/to Lua (%d)", size), 100000 / size + 10, [&](nap::utility::ErrorState& e) { return script.call("sumMap", e, sum, map); });
+		}
+	}
+
+
+	void benchmarkBuffer(nap::LuaScript& script)
+	{
+		nap::utility::ErrorState error;
+		bool has_ffi = false;
+		if (!script.call("hasFFI", error, has_ffi))
+		{
+			fail("buffer/FFI read (4096)", error);
+			return;
+		}
+		if (!has_ffi)
+		{
+			report("Skipping buffer benchmarks, the FFI is only available on LuaJIT");
+			return;
+		}
+
+		// The same data as the largest vector<float> benchmark, read in place instead of copied into a table.
+		std::vector<float> values(4096, 1.0f);
+		script.setBuffer("buffer", values.data(), values.size() * sizeof(float));
+		double sum = 0.0;
+		measure("buffer/FFI read (4096)", 100000 / 4096 + 10, [&](nap::utility::ErrorState& e) { return script.call("sumBuffer", e, sum); });
+	}
+
+
+	void benchmarkLoad(const std::filesystem::path& directory)
+	{
+		// Generated data scripts of increasing size.
+		for (int lines : { 100, 10000, 100000 })
+		{
+			std::string path = (directory / nap::utility::stringFormat("naplua_bench_%d.lua", lines)).string();
+			{
+				std::ofstream file(path);
+				file << "data = {}\n";
+				for (int i = 0; i < lines; i++)
+					file << "data[" << i + 1 << "] = { id = " << i << ", name = \"item" << i << "\", value = " << i * 0.5 << " }\n";
+			}
+			size_t file_size = std::filesystem::file_size(path);
+
+			int iterations = std::max(1000000 / lines, 3);
+			measure(nap::utility::stringFormat("init/compile and run (%zukB)", file_size / 1024), iterations, [&](nap::utility::ErrorState& e)
+			{
+				nap::LuaScript script;
+				script.mPath = path;
+				bool loaded = script.init(e) && e.check(script.mValid, "%s failed to load", path.c_str());
+				script.onDestroy();
+				return loaded;
+			});
+
+			nap::utility::ErrorState init_error;
+			nap::LuaScript script;
+			script.mPath = path;
+			std::string load_name = nap::utility::stringFormat("load/run compiled (%zukB)", file_size / 1024);
+			if (script.init(init_error) && init_error.check(script.mValid, "%s failed to load", path.c_str()))
+				measure(load_name, iterations, [&](nap::utility::ErrorState& e) { return script.load(e); });
+			else
+				fail(load_name, init_error);
+			script.onDestroy();
+			std::filesystem::remove(path);
+		}
+	}
+
+
+	void benchmarkGarbageCollection(nap::LuaScript& script, nap::ELuaGCMode mode, const std::string& modeName)
+	{
+		nap::utility::ErrorState e;
+		double count = 1000;
+		script.setGCMode(mode);
+		if (script.mGCMode != mode)
+		{
+			report("Skipping %s garbage collection benchmarks, not supported by %s", modeName.c_str(), nap::luacompat::getVersion());
+			return;
+		}
+
+		// Simulates frames that allocate short lived tables, with an explicit collection step in between.
+		script.setCallStatsEnabled(true);
+		script.getCallStats().clear();
+		std::vector<double> steps;
+		std::string frame_name = "gc/" + modeName + "/frame with 1000 tables, including automatic collection";
+		for (int frame = 0; frame < 2000; frame++)
+		{
+			if (!script.callVoid("churn", e, count))
+			{
+				fail(frame_name, e);
+				script.setCallStatsEnabled(false);
+				return;
+			}
+			auto start = Clock::now();
+			script.stepGarbageCollector(0);
+			steps.emplace_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count());
+		}
+
+		for (const auto& summary : script.getCallStats().getSummaries())
+			if (summary.mName == "churn")
+				storeDistribution(frame_name, summary);
+
+		std::sort(steps.begin(), steps.end());
+		Result result;
+		result.mName = "gc/" + modeName + "/explicit step";
+		result.mIterations = static_cast<int>(steps.size());
+		result.mP50 = steps[steps.size() / 2];
+		result.mP99 = steps[steps.size() * 99 / 100];
+		result.mMax = steps.back();
+		for (double step : steps)
+			result.mNanosecondsPerOp += step / steps.size();
+		sResults.emplace_back(result);
+		report("%-40s p50 %10.1f ns, p99 %10.1f ns, max %10.1f ns", result.mName.c_str(), result.mP50, result.mP99, result.mMax);
+		script.setCallStatsEnabled(false);
+	}
+
+
+	void benchmarkRealTime()
+	{
+		nap::utility::ErrorState error;
+		nap::LuaScript script;
+		script.mPath = NAPLUA_BENCH_SCRIPT;
+		script.mRealTime = true;
+		script.mProcessFunction = "processGain";
+		if (!script.init(error) || !script.mValid)
+		{
+			report("Skipping real-time benchmarks: %s", error.toString().c_str());
+			return;
+		}
+
+		// A stereo block of 256 frames, processed in place through the buffer views.
+		constexpr int frames = 256;
+		std::vector<float> left(frames, 0.5f), right(frames, 0.25f);
+		std::vector<float> out_left(frames), out_right(frames);
+		const float* inputs[] = { left.data(), right.data() };
+		float* outputs[] = { out_left.data(), out_right.data() };
+		measure("realtime/process stereo block (256 frames)", 1000, [&](nap::utility::ErrorState& e)
+		{
+			if (script.processBlock(inputs, 2, outputs, 2, frames))
+				return true;
+
+			// The real-time thread doesn't fail with an ErrorState, it keeps its first error.
+			std::string block_error = "block skipped";
+			script.takeRealTimeError(block_error);
+			e.fail(block_error);
+			return false;
+		});
+		measure("realtime/garbage collection step", 1000, [&](nap::utility::ErrorState& e) { script.collectGarbage(0); return true; });
+		report("Real-time arena: %zu of %zu bytes in use, %llu failed allocations", script.getArena().getUsedBytes(), script.getArena().getSize(),
+			static_cast<unsigned long long>(script.getArena().getFailedAllocations()));
+		script.onDestroy();
+	}
+
+
+	void benchmarkInterpreter(nap::LuaScript& script)
+	{
+		double count = 100000, result = 0.0;
+		measure("interpreter/numeric loop (x100000)", 20, [&](nap::utility::ErrorState& e) { return script.call("numericLoop", e, result, count); });
+	}
+
+
+	/**
+	 * Calls a function of a script as if it is updated every frame.
+	 */
+	int runScript(const std::string& path, const std::string& function)
+	{
+		nap::utility::ErrorState error;
+		nap::LuaScript script;
+		script.mPath = path;
+		if (!script.init(error) || !script.mValid)
+		{
+			report("Unable to load script: %s", error.toString().c_str());
+			return -1;
+		}
+
+		double delta_time = 1.0 / 60.0;
+		double result = 0.0;
+		measure("script/" + function, 100000, [&](nap::utility::ErrorState& e) { return script.call(function, e, result, delta_time); });
+		script.onDestroy();
+		return sFailed ? -1 : 0;
+	}
+
+
+	/**
+	 * @return the text as the contents of a JSON string
+	 */
+	std::string escapeJson(const std::string& text)
+	{
+		std::string escaped;
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+				escaped += '\\';
+			if (c == '\n')
+				escaped += "\\n";
+			else if (static_cast<unsigned char>(c) >= 0x20)
+				escaped += c;
+		}
+		return escaped;
+	}
+
+
+	std::string toJson()
+	{
+		std::ostringstream json;
+		json << "{\n\t\"lua\": \"" << nap::luacompat::getVersion() << "\",\n\t\"results\": [";
+		for (size_t i = 0; i < sResults.size(); i++)
+		{
+			const Result& result = sResults[i];
+			json << (i == 0 ? "\n" : ",\n");
+			json << "\t\t{ \"name\": \"" << result.mName << "\", \"iterations\": " << result.mIterations << ", \"ns_per_op\": " << result.mNanosecondsPerOp;
+			if (result.mMax > 0.0)
+				json << ", \"p50_ns\": " << result.mP50 << ", \"p99_ns\": " << result.mP99 << ", \"max_ns\": " << result.mMax;
+			if (result.mFailed)
+				json << ", \"failed\": true, \"error\": \"" << escapeJson(result.mError) << "\"";
+			json << " }";
+		}
+		json << "\n\t]\n}\n";
+		return json.str();
+	}
+}
+
+
+int main(int argc, char* argv[])
+{
+	if (argc == 4 && std::string(argv[1]) == "--script")
+		return runScript(argv[2], argv[3]);
+
+	nap::utility::ErrorState error;
+	nap::LuaScript script;
+	script.mPath = NAPLUA_BENCH_SCRIPT;
+	if (!script.init(error) || !script.mValid)
+	{
+		report("Unable to load benchmark script: %s", error.toString().c_str());
+		return -1;
+	}
+
+	// Types used in the script have to be bound before it is loaded again.
+	bindVec3(script);
+	if (!script.load(error))
+	{
+		report("Unable to load benchmark script: %s", error.toString().c_str());
+		return -1;
+	}
+
+	benchmarkCalls(script);
+	benchmarkVariables(script);
+	benchmarkUserdata(script);
+	benchmarkTables(script);
+	benchmarkBuffer(script);
+	benchmarkInterpreter(script);
+	benchmarkGarbageCollection(script, nap::ELuaGCMode::Incremental, "incremental");
+	benchmarkGarbageCollection(script, nap::ELuaGCMode::Generational, "generational");
+	benchmarkLoad(std::filesystem::temp_directory_path());
+	benchmarkRealTime();
+	script.onDestroy();
+
+	// Results go to the given file, or to stdout. Failed benchmarks are part of the results, the run still fails.
+	std::string json = toJson();
+	if (argc < 2)
+	{
+		std::printf("%s", json.c_str());
+		return sFailed ? -1 : 0;
+	}
+
+	std::ofstream file(argv[1]);
+	file << json;
+	if (!file.good())
+	{
+		report("Unable to write results to %s", argv[1]);
+		return -1;
+	}
+	return sFailed ? -1 : 0;
+}
@@ -0,0 +1,99 @@
+-- Functions and variables used by naplua_bench.
+
+-- The FFI is only available on LuaJIT.
+local ffi = jit ~= nil and require("ffi") or nil
+
+intValue = 42
+floatValue = 0.5
+stringValue = "naplua"
+
+function noArgs()
+end
+
+function oneNumber(a)
+end
+
+function threeNumbers(a, b, c)
+end
+
+function add(a, b)
+	return a + b
+end
+
+function echoString(s)
+	return s
+end
+
+function createVectors(count)
+	for i = 1, count do
+		local v = vec3(i, i, i)
+	end
+end
+
+function addVectors(a, b)
+	return a + b
+end
+
+function sumArray(values)
+	local sum = 0
+	for i = 1, #values do
+		sum = sum + values[i]
+	end
+	return sum
+end
+
+function makeArray(count)
+	local values = {}
+	for i = 1, count do
+		values[i] = i
+	end
+	return values
+end
+
+function sumMap(values)
+	local sum = 0
+	for _, v in pairs(values) do
+		sum = sum + v
+	end
+	return sum
+end
+
+function hasFFI()
+	return ffi ~= nil
+end
+
+-- Sums the floats of the buffer exposed with setBuffer(), read in place through the FFI.
+function sumBuffer()
+	local values = ffi.cast("const float*", buffer.data)
+	local sum = 0
+	for i = 0, buffer.size / 4 - 1 do
+		sum = sum + values[i]
+	end
+	return sum
+end
+
+-- Real-time process callback: applies a gain to every channel, through the buffer views.
+function processGain(inputs, outputs, frames)
+	for c = 1, #outputs do
+		local input, output = inputs[c], outputs[c]
+		for i = 1, frames do
+			output[i] = input[i] * 0.5
+		end
+	end
+end
+
+-- Allocates short lived tables, like a script that builds per-frame data.
+function churn(count)
+	for i = 1, count do
+		local t = { x = i, y = i, z = { i } }
+	end
+end
+
+-- Tight numeric loop, measures raw interpreter throughput.
+function numericLoop(count)
+	local x = 0.0
+	for i = 1, count do
+		x = x + math.sin(i) * 0.5
+	end
+	return x
+end
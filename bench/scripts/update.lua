@@ -0,0 +1,16 @@
+-- A per-frame update in the style of the demo script, for the profile guided optimisation training run.
+-- The demo script moves the world and sets the halo through handles the app gives it, this one keeps the values in Lua.
+
+timePassed = 0.0
+translate = { 0, 0, 0 }
+halo = { 0, 0, 0 }
+
+function update(t)
+	timePassed = timePassed + t
+	local x = math.sin(timePassed)
+	translate[1] = x
+	
+	local pulse = 0.75 + 0.25 * math.sin(timePassed * 2.0)
+	halo[1], halo[2], halo[3] = pulse, pulse, pulse
+	return x
+end
@@ -1,7 +1,22 @@
 
 timePassed = 0.0
+clicks = 0
 
 function update(t)
 	timePassed = timePassed + t
-	return math.sin(timePassed);
+	local x = math.sin(timePassed)
+	
+	-- The world and halo handles are set by the app
+	world:setTranslate(x, 0, 0)
+	local pulse = 0.75 + 0.25 * math.sin(timePassed * 2.0)
+	halo:set(pulse, pulse, pulse)
+	return x;
+end
+
+function onInput(events)
+	for i = 1, #events do
+		if events:get(i) == "pointerPress" then
+			clicks = clicks + 1
+		end
+	end
 end
\ No newline at end of file
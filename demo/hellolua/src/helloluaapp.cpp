@@ -58,8 +58,17 @@ namespace nap
 		mColorOne = { mColorTwo[0] * 0.9f, mColorTwo[1] * 0.9f, mColorTwo[2] };
 		mHaloColor = mGuiService->getPalette().mFront4Color.convert<RGBColorFloat>();
 		
-		// Find the Lua script
+		// Look the color uniforms up once, instead of every frame
+		nap::RenderableMeshComponentInstance& renderer = mWorldEntity->getComponent<nap::RenderableMeshComponentInstance>();
+		nap::UniformStructInstance* ubo = renderer.getMaterialInstance().getOrCreateUniform("UBO");
+		mColorOneUniform = ubo->getOrCreateUniform<nap::UniformVec3Instance>("colorOne");
+		mColorTwoUniform = ubo->getOrCreateUniform<nap::UniformVec3Instance>("colorTwo");
+		mHaloColorUniform = ubo->getOrCreateUniform<nap::UniformVec3Instance>("haloColor");
+		
+		// Find the Lua script and give it direct access to the transform of the world and the halo color, which it animates
 		mLuaScript = mResourceManager->findObject<LuaScript>("Script");
+		if (!bindLua(error))
+			return false;
 		
 		// Cap the frame rate
 		capFramerate(true);
@@ -75,19 +84,25 @@ namespace nap
 	 */
 	void HelloLuaApp::update(double deltaTime)
 	{
-		// Create an input router, the default one forwards messages to mouse and keyboard input components
-		nap::DefaultInputRouter input_router;
+		// A hot reload of the script replaces it with a new resource, which doesn't have the handles yet
+		if (mLuaScript.get() != mBoundLuaScript)
+		{
+			utility::ErrorState bind_error;
+			if (!bindLua(bind_error))
+				Logger::warn(bind_error.toString());
+		}
+		
+		// Collect the input events for the Lua script, the router passes them on to the default router
+		// which forwards them to the mouse and keyboard input components
+		mLuaInputRouter.clear();
 		
 		// Now forward all input events associated with the first window to the listening components
 		std::vector<nap::EntityInstance*> entities = { mPerspectiveCamEntity.get() };
-		mInputService->processWindowEvents(*mRenderWindow, input_router, entities);
+		mInputService->processWindowEvents(*mRenderWindow, mLuaInputRouter, entities);
 
 		// Push the current color selection to the shader.
-		nap::RenderableMeshComponentInstance& renderer = mWorldEntity->getComponent<nap::RenderableMeshComponentInstance>();
-		auto ubo = renderer.getMaterialInstance().getOrCreateUniform("UBO");
-		ubo->getOrCreateUniform<nap::UniformVec3Instance>("colorOne")->setValue(mColorOne);
-		ubo->getOrCreateUniform<nap::UniformVec3Instance>("colorTwo")->setValue(mColorTwo);
-		ubo->getOrCreateUniform<nap::UniformVec3Instance>("haloColor")->setValue(mHaloColor);
+		mColorOneUniform->setValue(mColorOne);
+		mColorTwoUniform->setValue(mColorTwo);
 
 		// Setup GUI
 		ImGui::Begin("Controls");
@@ -101,6 +116,7 @@ namespace nap
 		{
 			ImGui::ColorEdit3("Color One", mColorOne.getData());
 			ImGui::ColorEdit3("Color Two", mColorTwo.getData());
+			ImGui::Checkbox("Override Halo", &mOverrideHalo);
 			ImGui::ColorEdit3("Halo Color", mHaloColor.getData());
 		}
 
@@ -116,36 +132,158 @@ namespace nap
 		
 		// Update Lua script and its GUI window
 		updateLua(deltaTime);
+		
+		// The script animates the halo color, unless it is overridden from the GUI
+		if (mOverrideHalo)
+			mHaloColorUniform->setValue(mHaloColor);
+		
+		// Show the profiler of all Lua scripts
+		updateLuaProfiler();
 
 	}
 	
+	bool HelloLuaApp::bindLua(utility::ErrorState& error)
+	{
+		mBoundLuaScript = mLuaScript.get();
+		return mLuaScript->setTransform("world", mWorldEntity->getComponent<nap::TransformComponentInstance>(), error) &&
+			mLuaScript->setUniform("halo", *mHaloColorUniform, error);
+	}
+	
+	
 	void HelloLuaApp::updateLua(double deltaTime)
 	{
+		// Pass the input events of this frame to the script in a single call
+		utility::ErrorState input_error;
+		if (!mLuaInputRouter.deliver(*mLuaScript, input_error))
+			Logger::info(input_error.toString());
+		
 		// Get a variable value from the Lua script
 		utility::ErrorState e1;
 		float time_passed;
 		if(!mLuaScript->getVariable("timePassed", e1, time_passed))
 			Logger::info(e1.toString());
 		
-		// Call a fuction in the Lua script
+		// Call a fuction in the Lua script, which moves the world through its transform handle
 		float output = 0.f;
 		utility::ErrorState e2;
 		if(!mLuaScript->call("update", e2, output, deltaTime))
 			Logger::info(e2.toString());
 		
-		// Set the world position based on Lua script output
-		nap::TransformComponentInstance& world_transform = mWorldEntity->getComponent<nap::TransformComponentInstance>();
-		world_transform.setTranslate(glm::vec3(output, 0, 0));
-		
 		// Show the GUI window
 		ImGui::Begin("From Lua");
 		ImGui::SliderFloat("Function output", &output, -10.f, 10.f);
 		std::string value_as_string = std::to_string(time_passed);
 		ImGui::LabelText("Variable value", value_as_string.c_str());
+		int clicks = 0;
+		utility::ErrorState clicks_error;
+		if (mLuaScript->getVariable("clicks", clicks_error, clicks))
+			ImGui::Text("Clicks: %d", clicks);
 		if(e1.hasErrors())
 			ImGui::Text(e1.toString().c_str());
 		if(e2.hasErrors())
-			ImGui::Text(e1.toString().c_str());
+			ImGui::Text(e2.toString().c_str());
+		ImGui::End();
+	}
+	
+	
+	void HelloLuaApp::updateLuaProfiler()
+	{
+		ImGui::Begin("Lua Profiler");
+		if (ImGui::Checkbox("Profile", &mProfileLua))
+		{
+			for (auto& script : mResourceManager->getObjects<LuaScript>())
+			{
+				if (mProfileLua)
+					script->startProfiling();
+				else
+					script->stopProfiling();
+			}
+		}
+		
+		// Share of the total time spent in Lua per script
+		auto scripts = mResourceManager->getObjects<LuaScript>();
+		double total_time = 0.0;
+		for (auto& script : scripts)
+			total_time += script->getProfiler().getProfiledTime();
+		
+		for (auto& script : scripts)
+		{
+			LuaProfiler& profiler = script->getProfiler();
+			float share = total_time > 0.0 ? static_cast<float>(profiler.getProfiledTime() / total_time) : 0.0f;
+			ImGui::ProgressBar(share, ImVec2(-1.0f, 0.0f), utility::stringFormat("%s: %.1f%% (%.02fms, %llu samples)", script->mID.c_str(), share * 100.0f, profiler.getProfiledTime() * 1000.0, static_cast<unsigned long long>(profiler.getSampleCount())).c_str());
+			ImGui::PushID(script.get());
+			if (ImGui::Button("Write flamegraph"))
+			{
+				utility::ErrorState error;
+				if (!profiler.writeCollapsedStacks(script->mID + ".folded", error))
+					Logger::warn(error.toString());
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Clear"))
+				profiler.clear();
+			ImGui::PopID();
+		}
+		
+		// Timeline of the work done by all scripts
+		if (ImGui::Checkbox("Trace", &mTraceLua))
+		{
+			for (auto& script : scripts)
+			{
+				if (mTraceLua)
+					script->startTracing();
+				else
+					script->stopTracing();
+			}
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Write trace"))
+		{
+			std::vector<std::pair<const LuaTracer*, std::string>> tracers;
+			for (auto& script : scripts)
+				tracers.emplace_back(&script->getTracer(), script->mID);
+			utility::ErrorState error;
+			if (!LuaTracer::writeChromeTrace("lua_trace.json", tracers, error))
+				Logger::warn(error.toString());
+		}
+		
+		// Lines that allocate the most Lua memory
+		if (ImGui::CollapsingHeader("Memory"))
+		{
+			if (ImGui::Checkbox("Record allocation sites", &mProfileLuaMemory))
+			{
+				for (auto& script : scripts)
+				{
+					if (mProfileLuaMemory)
+						script->startMemoryProfiling();
+					else
+						script->stopMemoryProfiling();
+				}
+			}
+			
+			for (auto& script : scripts)
+			{
+				ImGui::Text("%s: %.01fkB allocated", script->mID.c_str(), script->getAllocatedBytes() / 1024.0);
+				for (const auto& site : script->getMemoryProfiler().getTopSites(5, true))
+					ImGui::Text("  %s: %llu allocations last frame, %lldB live", site.mName.c_str(), static_cast<unsigned long long>(site.mLastFrameAllocations), static_cast<long long>(site.mLiveBytes));
+			}
+		}
+		
+		// Latency distribution of the calls into the scripts
+		if (ImGui::CollapsingHeader("Call latency"))
+		{
+			if (ImGui::Checkbox("Record calls", &mRecordLuaCalls))
+				for (auto& script : scripts)
+					script->setCallStatsEnabled(mRecordLuaCalls);
+			
+			for (auto& script : scripts)
+			{
+				for (const auto& summary : script->getCallStats().getSummaries())
+				{
+					ImGui::Text("%s.%s: %llu calls (%llu last frame)", script->mID.c_str(), summary.mName.c_str(), static_cast<unsigned long long>(summary.mCount), static_cast<unsigned long long>(summary.mLastFrameCount));
+					ImGui::Text("  p50 %.03fus, p99 %.03fus, max %.03fus", summary.mP50 * 1e6, summary.mP99 * 1e6, summary.mMax * 1e6);
+				}
+			}
+		}
 		ImGui::End();
 	}
 
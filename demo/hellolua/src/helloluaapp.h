@@ -19,6 +19,7 @@
 
 // Lua include
 #include <LuaScript.h>
+#include <LuaInputRouter.h>
 
 namespace nap
 {
@@ -64,7 +65,9 @@ namespace nap
 		int shutdown() override;
 		
 	private:
+		bool bindLua(utility::ErrorState& error);
 		void updateLua(double deltaTime);
+		void updateLuaProfiler();
 		
 		// Nap Services
 		RenderService* mRenderService = nullptr;						//< Render Service that handles render calls
@@ -80,8 +83,19 @@ namespace nap
 
 		RGBColorFloat mColorOne;										//< First sphere blend color
 		RGBColorFloat mColorTwo;										//< Second sphere blend color
-		RGBColorFloat mHaloColor;										//< Sphere halo color
+		RGBColorFloat mHaloColor;										//< Sphere halo color, when it overrides the color animated by Lua
+		bool mOverrideHalo = false;										//< Whether the halo color of the GUI overrides the one animated by Lua
+		UniformVec3Instance* mColorOneUniform = nullptr;				//< First sphere blend color in the shader
+		UniformVec3Instance* mColorTwoUniform = nullptr;				//< Second sphere blend color in the shader
+		UniformVec3Instance* mHaloColorUniform = nullptr;				//< Sphere halo color in the shader, animated by the Lua script
 		
 		ResourcePtr<LuaScript> mLuaScript = nullptr;					//< Pointer to the Lua script resource
+		LuaScript* mBoundLuaScript = nullptr;							//< The script the handles were given to, replaced by a hot reload
+		DefaultInputRouter mInputRouter;								//< Forwards input events to the mouse and keyboard input components
+		LuaInputRouter mLuaInputRouter = { 256, &mInputRouter };		//< Collects the input events of a frame for the Lua script
+		bool mProfileLua = false;										//< Whether the Lua scripts are being profiled
+		bool mProfileLuaMemory = false;									//< Whether Lua allocations are attributed to source lines
+		bool mTraceLua = false;											//< Whether the Lua scripts are being traced
+		bool mRecordLuaCalls = false;									//< Whether the latency of calls into the Lua scripts is recorded
 	};
 }
@@ -1,7 +1,121 @@
-add_subdirectory(thirdparty/lua52)
+# The Lua implementation: the bundled Lua 5.2, Lua 5.4 built from source with its generational garbage collector and integers,
+# or an installed LuaJIT which runs numeric code much faster and has the FFI.
+set(NAPLUA_LUA_BACKEND "lua52" CACHE STRING "Lua implementation: lua52 (bundled), lua54 (built from source) or luajit (installed)")
+set_property(CACHE NAPLUA_LUA_BACKEND PROPERTY STRINGS lua52 lua54 luajit)
 
-target_link_import_library(${PROJECT_NAME} lua52)
+if(NAPLUA_LUA_BACKEND STREQUAL "luajit")
+    add_subdirectory(thirdparty/luajit)
+    set(naplua_lua_target luajit)
+    target_link_libraries(${PROJECT_NAME} luajit)
+elseif(NAPLUA_LUA_BACKEND STREQUAL "lua54")
+    add_subdirectory(thirdparty/lua54)
+    set(naplua_lua_target lua54)
+    add_license(lua54 ${CMAKE_CURRENT_SOURCE_DIR}/thirdparty/lua54/LICENSE.txt)
+    target_link_libraries(${PROJECT_NAME} lua54)
+    get_target_property(lua_ipo lua54 INTERPROCEDURAL_OPTIMIZATION)
+    if(lua_ipo)
+        set_target_properties(${PROJECT_NAME} PROPERTIES INTERPROCEDURAL_OPTIMIZATION ON)
+    endif()
+elseif(NAPLUA_LUA_BACKEND STREQUAL "lua52")
+    add_subdirectory(thirdparty/lua52)
+    set(naplua_lua_target lua52)
+    add_license(lua52 ${CMAKE_CURRENT_SOURCE_DIR}/thirdparty/lua52/LICENSE.txt)
+
+    if(UNIX AND NOT APPLE)
+        # Lua is built from source as a static library on Linux, link time optimised together with the bindings.
+        target_link_libraries(${PROJECT_NAME} lua52)
+        target_compile_options(${PROJECT_NAME} PRIVATE -fno-plt)
+        get_target_property(lua_ipo lua52 INTERPROCEDURAL_OPTIMIZATION)
+        if(lua_ipo)
+            set_target_properties(${PROJECT_NAME} PROPERTIES INTERPROCEDURAL_OPTIMIZATION ON)
+        endif()
+    else()
+        target_link_import_library(${PROJECT_NAME} lua52)
+    endif()
+else()
+    message(FATAL_ERROR "Unknown NAPLUA_LUA_BACKEND: ${NAPLUA_LUA_BACKEND}")
+endif()
+
+# Profile guided optimisation of the Lua core (when built from source) and the bindings:
+# 1. configure with NAPLUA_PGO=GENERATE and NAPLUA_BENCHMARKS=ON, build and run the naplua_pgo_train target
+# 2. reconfigure the same build directory with NAPLUA_PGO=USE and rebuild
+set(NAPLUA_PGO "OFF" CACHE STRING "Profile guided optimisation stage: OFF, GENERATE (instrumented build) or USE (optimised build)")
+set_property(CACHE NAPLUA_PGO PROPERTY STRINGS OFF GENERATE USE)
+set(NAPLUA_PGO_DIR ${CMAKE_BINARY_DIR}/naplua_pgo CACHE PATH "Directory the training profiles are written to and read from")
+
+# Clang writes raw profiles that are merged into naplua.profdata, they get their own directory so the merge only sees them.
+set(naplua_pgo_raw_dir ${NAPLUA_PGO_DIR}/raw)
+
+function(naplua_apply_pgo target)
+    if(NAPLUA_PGO STREQUAL "GENERATE")
+        if(CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+            set(profile_dir ${naplua_pgo_raw_dir})
+        else()
+            set(profile_dir ${NAPLUA_PGO_DIR})
+        endif()
+        target_compile_options(${target} PRIVATE -fprofile-generate=${profile_dir})
+        target_link_options(${target} PRIVATE -fprofile-generate=${profile_dir})
+    elseif(NAPLUA_PGO STREQUAL "USE")
+        if(CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+            set(profile ${NAPLUA_PGO_DIR}/naplua.profdata)
+        else()
+            set(profile ${NAPLUA_PGO_DIR})
+        endif()
+        target_compile_options(${target} PRIVATE -fprofile-use=${profile} -Wno-missing-profile)
+        if(CMAKE_CXX_COMPILER_ID STREQUAL "GNU")
+            # Code the training run didn't reach is optimised normally instead of for size.
+            target_compile_options(${target} PRIVATE -fprofile-partial-training -fprofile-correction)
+        endif()
+        target_link_options(${target} PRIVATE -fprofile-use=${profile})
+    endif()
+endfunction()
+
+if(NOT NAPLUA_PGO STREQUAL "OFF")
+    if(MSVC)
+        message(FATAL_ERROR "NAPLUA_PGO is only supported with GCC and Clang")
+    endif()
+    naplua_apply_pgo(${PROJECT_NAME})
+    get_target_property(lua_imported ${naplua_lua_target} IMPORTED)
+    get_target_property(lua_type ${naplua_lua_target} TYPE)
+    if(NOT lua_imported AND lua_type STREQUAL "STATIC_LIBRARY")
+        naplua_apply_pgo(${naplua_lua_target})
+    else()
+        message(STATUS "Lua is a prebuilt library, profile guided optimisation only applies to the bindings")
+    endif()
+endif()
 
 add_license(luabridge ${CMAKE_CURRENT_SOURCE_DIR}/thirdparty/LuaBridge/LICENSE.txt)
 
-add_license(lua52 ${CMAKE_CURRENT_SOURCE_DIR}/thirdparty/lua52/LICENSE.txt)
+# Headless benchmarks of the binding layer, see bench/naplua_bench.cpp
+option(NAPLUA_BENCHMARKS "Build the naplua_bench benchmark target" OFF)
+if(NAPLUA_BENCHMARKS)
+    add_executable(naplua_bench ${CMAKE_CURRENT_SOURCE_DIR}/bench/naplua_bench.cpp)
+    target_link_libraries(naplua_bench ${PROJECT_NAME})
+    target_compile_definitions(naplua_bench PRIVATE NAPLUA_BENCH_SCRIPT="${CMAKE_CURRENT_SOURCE_DIR}/bench/scripts/bench.lua")
+
+    if(NAPLUA_PGO STREQUAL "GENERATE")
+        naplua_apply_pgo(naplua_bench)
+
+        # Training run: the benchmark scenarios followed by an update script like the demo's.
+        # The results of the training run are not kept with the profiles.
+        file(MAKE_DIRECTORY ${NAPLUA_PGO_DIR})
+        set(train_commands)
+        if(CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+            # Raw profiles of an earlier training run are removed, the merge reads every file in their directory.
+            list(APPEND train_commands
+                COMMAND ${CMAKE_COMMAND} -E remove_directory ${naplua_pgo_raw_dir}
+                COMMAND ${CMAKE_COMMAND} -E make_directory ${naplua_pgo_raw_dir})
+        endif()
+        list(APPEND train_commands
+            COMMAND naplua_bench ${CMAKE_CURRENT_BINARY_DIR}/naplua_pgo_training.json
+            COMMAND naplua_bench --script ${CMAKE_CURRENT_SOURCE_DIR}/bench/scripts/update.lua update)
+        if(CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+            find_program(LLVM_PROFDATA NAMES llvm-profdata REQUIRED)
+            list(APPEND train_commands COMMAND ${LLVM_PROFDATA} merge -output=${NAPLUA_PGO_DIR}/naplua.profdata ${naplua_pgo_raw_dir})
+        endif()
+        add_custom_target(naplua_pgo_train ${train_commands}
+            DEPENDS naplua_bench
+            WORKING_DIRECTORY ${NAPLUA_PGO_DIR}
+            COMMENT "Training naplua for profile guided optimisation")
+    endif()
+endif()
@@ -0,0 +1,117 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "LuaArena.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace nap
+{
+
+	bool LuaArena::init(size_t size, utility::ErrorState& errorState)
+	{
+		size_t count = (size + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t);
+		mMemory.reset(new (std::nothrow) std::max_align_t[count]);
+		if (!errorState.check(mMemory != nullptr, "Unable to allocate a Lua arena of %zu bytes", size))
+			return false;
+
+		// Touch every page now, instead of on the real-time thread.
+		mBegin = reinterpret_cast<char*>(mMemory.get());
+		mEnd = mBegin + count * sizeof(std::max_align_t);
+		std::memset(mBegin, 0, mEnd - mBegin);
+
+		mUnused = mBegin;
+		mFreeLists.fill(nullptr);
+		mUsedBytes = 0;
+		mFailedAllocations = 0;
+		return true;
+	}
+
+
+	void* LuaArena::reallocate(void* block, size_t newSize)
+	{
+		if (newSize == 0)
+		{
+			if (block != nullptr)
+				free(block);
+			return nullptr;
+		}
+
+		if (block == nullptr)
+			return allocate(newSize);
+
+		// The block is kept when it is large enough, which also makes shrinking infallible, as Lua requires.
+		int size_class = *reinterpret_cast<int*>(static_cast<char*>(block) - sHeaderSize);
+		size_t capacity = getClassSize(size_class);
+		if (newSize <= capacity)
+			return block;
+
+		void* new_block = allocate(newSize);
+		if (new_block == nullptr)
+			return nullptr;
+		std::memcpy(new_block, block, capacity);
+		free(block);
+		return new_block;
+	}
+
+
+	int LuaArena::getSizeClass(size_t size)
+	{
+		int size_class = 0;
+		while (size_class < sClassCount - 1 && getClassSize(size_class) < size)
+			size_class++;
+		return size_class;
+	}
+
+
+	void* LuaArena::allocate(size_t size)
+	{
+		int size_class = getSizeClass(size);
+		size_t capacity = getClassSize(size_class);
+		if (capacity < size)
+		{
+			mFailedAllocations++;
+			return nullptr;
+		}
+
+		char* header = nullptr;
+		if (mFreeLists[size_class] != nullptr)
+		{
+			// Reuse a freed block of the same class.
+			FreeBlock* free_block = mFreeLists[size_class];
+			mFreeLists[size_class] = free_block->mNext;
+			header = reinterpret_cast<char*>(free_block);
+		}
+		else
+		{
+			if (static_cast<size_t>(mEnd - mUnused) < sHeaderSize + capacity)
+			{
+				mFailedAllocations++;
+				return nullptr;
+			}
+			header = mUnused;
+			mUnused += sHeaderSize + capacity;
+		}
+
+		*reinterpret_cast<int*>(header) = size_class;
+		mUsedBytes += capacity;
+		return header + sHeaderSize;
+	}
+
+
+	void LuaArena::free(void* block)
+	{
+		char* header = static_cast<char*>(block) - sHeaderSize;
+		int size_class = *reinterpret_cast<int*>(header);
+		mUsedBytes -= getClassSize(size_class);
+
+		// The free list link overwrites the header, the class is written again when the block is reused.
+		auto* free_block = reinterpret_cast<FreeBlock*>(header);
+		free_block->mNext = mFreeLists[size_class];
+		mFreeLists[size_class] = free_block;
+	}
+
+}
@@ -0,0 +1,88 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <utility/dllexport.h>
+#include <utility/errorstate.h>
+#include <nap/numeric.h>
+
+#include <array>
+#include <cstddef>
+#include <memory>
+
+namespace nap
+{
+
+	/**
+	 * Fixed block of memory a real-time Lua state allocates from, instead of the system allocator.
+	 * Blocks are rounded up to a power of two size class. Freed blocks go to the free list of their class and are reused for the same class,
+	 * new blocks are cut from the unused end of the arena. An allocation that doesn't fit fails, it never falls back on malloc.
+	 * Not thread safe: used by one thread at a time, like the state that owns it.
+	 */
+	class NAPAPI LuaArena final
+	{
+	public:
+		/**
+		 * Allocates the arena and touches all of its pages, so allocating from it later doesn't page fault.
+		 * @param size size of the arena in bytes
+		 * @param errorState contains the error if the memory can't be allocated
+		 * @return whether the arena was allocated
+		 */
+		bool init(size_t size, utility::ErrorState& errorState);
+
+		/**
+		 * @return whether the arena is allocated
+		 */
+		bool isAllocated() const { return mMemory != nullptr; }
+
+		/**
+		 * Allocates, resizes or frees a block, with the semantics of a lua_Alloc function. Shrinking never fails.
+		 * @param block the block to resize or free, nullptr to allocate
+		 * @param newSize new size in bytes, 0 to free the block
+		 * @return the new block, nullptr when it was freed or doesn't fit
+		 */
+		void* reallocate(void* block, size_t newSize);
+
+		/**
+		 * @return size of the arena in bytes
+		 */
+		size_t getSize() const { return static_cast<size_t>(mEnd - mBegin); }
+
+		/**
+		 * @return bytes of the arena taken by blocks that are in use, rounded up to their size class
+		 */
+		size_t getUsedBytes() const { return mUsedBytes; }
+
+		/**
+		 * @return number of allocations that failed because the arena was full
+		 */
+		uint64 getFailedAllocations() const { return mFailedAllocations; }
+
+	private:
+		static constexpr int sClassCount = 32;
+		static constexpr size_t sMinBlockSize = 16;
+		static constexpr size_t sHeaderSize = 16;	///< Keeps the size class of a block, and blocks aligned to 16 bytes
+
+		struct FreeBlock
+		{
+			FreeBlock* mNext = nullptr;
+		};
+
+		static int getSizeClass(size_t size);
+		static size_t getClassSize(int sizeClass) { return sMinBlockSize << sizeClass; }
+
+		void* allocate(size_t size);
+		void free(void* block);
+
+		std::unique_ptr<std::max_align_t[]> mMemory;
+		char* mBegin = nullptr;
+		char* mEnd = nullptr;
+		char* mUnused = nullptr;	///< Start of the part of the arena no block was cut from yet
+		std::array<FreeBlock*, sClassCount> mFreeLists = {};
+		size_t mUsedBytes = 0;
+		uint64 mFailedAllocations = 0;
+	};
+
+}
@@ -0,0 +1,135 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "LuaBufferView.h"
+
+#include <new>
+
+namespace nap
+{
+
+	namespace
+	{
+		const char* sMetatableName = "nap.LuaBufferView";
+
+
+		// The metatable is hidden from scripts, so the first argument of its functions is always a view.
+		LuaBufferView* toView(lua_State* L)
+		{
+			return static_cast<LuaBufferView*>(lua_touserdata(L, 1));
+		}
+
+
+		int index(lua_State* L)
+		{
+			LuaBufferView* view = toView(L);
+			lua_Integer i = lua_tointeger(L, 2);
+			if (i >= 1 && i <= view->mSize)
+				lua_pushnumber(L, view->mData[i - 1]);
+			else
+				lua_pushnil(L);
+			return 1;
+		}
+
+
+		int newIndex(lua_State* L)
+		{
+			LuaBufferView* view = toView(L);
+			if (!view->mWritable)
+				return luaL_error(L, "buffer is read only");
+
+			lua_Integer i = lua_tointeger(L, 2);
+			if (i < 1 || i > view->mSize)
+				return luaL_error(L, "buffer index %d out of range 1-%d", static_cast<int>(i), view->mSize);
+			view->mData[i - 1] = static_cast<float>(luaL_checknumber(L, 3));
+			return 0;
+		}
+
+
+		int length(lua_State* L)
+		{
+			lua_pushinteger(L, toView(L)->mSize);
+			return 1;
+		}
+	}
+
+
+	LuaBufferView* LuaBufferView::push(lua_State* L, bool writable)
+	{
+		auto* view = new (lua_newuserdata(L, sizeof(LuaBufferView))) LuaBufferView();
+		view->mWritable = writable;
+
+		if (luaL_newmetatable(L, sMetatableName))
+		{
+			lua_pushcfunction(L, &index);
+			lua_setfield(L, -2, "__index");
+			lua_pushcfunction(L, &newIndex);
+			lua_setfield(L, -2, "__newindex");
+			lua_pushcfunction(L, &length);
+			lua_setfield(L, -2, "__len");
+			lua_pushstring(L, "LuaBufferView");
+			lua_setfield(L, -2, "__metatable");
+		}
+		lua_setmetatable(L, -2);
+		return view;
+	}
+
+
+	LuaBufferView* LuaBufferView::to(lua_State* L, int index)
+	{
+		void* data = lua_touserdata(L, index);
+		if (data == nullptr || !lua_getmetatable(L, index))
+			return nullptr;
+
+		luaL_getmetatable(L, sMetatableName);
+		bool is_view = lua_rawequal(L, -1, -2) != 0;
+		lua_pop(L, 2);
+		return is_view ? static_cast<LuaBufferView*>(data) : nullptr;
+	}
+
+
+	LuaFloatArray::LuaFloatArray(lua_State* L, int index, int count, bool write) :
+		L(L), mIndex(luacompat::absIndex(L, index)), mView(LuaBufferView::to(L, index))
+	{
+		if (mView != nullptr)
+		{
+			if (write && !mView->mWritable)
+				luaL_error(L, "buffer is read only");
+			if (mView->mSize < count)
+				luaL_error(L, "buffer holds %d values, %d required", mView->mSize, count);
+			return;
+		}
+
+		luaL_checktype(L, mIndex, LUA_TTABLE);
+		int length = static_cast<int>(luacompat::rawLength(L, mIndex));
+		if (!write && length < count)
+			luaL_error(L, "table holds %d values, %d required", length, count);
+	}
+
+
+	float LuaFloatArray::get(int i) const
+	{
+		if (mView != nullptr)
+			return mView->mData[i];
+
+		lua_rawgeti(L, mIndex, i + 1);
+		float value = static_cast<float>(lua_tonumber(L, -1));
+		lua_pop(L, 1);
+		return value;
+	}
+
+
+	void LuaFloatArray::set(int i, float value)
+	{
+		if (mView != nullptr)
+		{
+			mView->mData[i] = value;
+			return;
+		}
+
+		lua_pushnumber(L, value);
+		lua_rawseti(L, mIndex, i + 1);
+	}
+
+}
@@ -0,0 +1,73 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include "LuaCompat.h"
+
+#include <utility/dllexport.h>
+
+namespace nap
+{
+
+	/**
+	 * Userdata that gives a script indexed access to a block of samples owned by C++, without copying them.
+	 * In Lua, view[i] reads and writes sample i (1 based) and #view is the number of samples.
+	 * A view is created once and pointed at a new block every time it is used, so using it doesn't allocate.
+	 */
+	struct NAPAPI LuaBufferView final
+	{
+		float* mData = nullptr;		///< The samples, owned by C++
+		int mSize = 0;				///< Number of samples
+		bool mWritable = false;		///< Whether the script may write the samples
+
+		/**
+		 * Creates a view that doesn't point at any samples yet and pushes it on the stack of the state.
+		 * @param L the Lua state
+		 * @param writable whether the script may write the samples
+		 * @return the view, which lives as long as Lua keeps a reference to it
+		 */
+		static LuaBufferView* push(lua_State* L, bool writable);
+
+		/**
+		 * @param L the Lua state
+		 * @param index stack index of the value
+		 * @return the view at 'index', nullptr when the value is not a view
+		 */
+		static LuaBufferView* to(lua_State* L, int index);
+	};
+
+
+	/**
+	 * The flat array of numbers a batch function reads or writes, a LuaBufferView or a Lua table, accessed without creating values.
+	 * Raises a Lua error when the array is too small or, when it is written, read only.
+	 */
+	class NAPAPI LuaFloatArray final
+	{
+	public:
+		/**
+		 * @param L the Lua state
+		 * @param index stack index of the array
+		 * @param count number of values that are read or written
+		 * @param write whether values are written, a table grows to hold them
+		 */
+		LuaFloatArray(lua_State* L, int index, int count, bool write);
+
+		/**
+		 * @return value i (0 based)
+		 */
+		float get(int i) const;
+
+		/**
+		 * Sets value i (0 based).
+		 */
+		void set(int i, float value);
+
+	private:
+		lua_State* L;
+		int mIndex;
+		LuaBufferView* mView;
+	};
+
+}
@@ -0,0 +1,101 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "LuaBytecodeCache.h"
+
+#include <filesystem>
+
+namespace nap
+{
+
+	bool LuaFileStamp::get(const std::string& path, LuaFileStamp& stamp)
+	{
+		std::error_code error;
+		auto size = std::filesystem::file_size(path, error);
+		if (error)
+			return false;
+		auto modified = std::filesystem::last_write_time(path, error);
+		if (error)
+			return false;
+
+		stamp.mSize = static_cast<uint64>(size);
+		stamp.mModified = static_cast<int64>(modified.time_since_epoch().count());
+		return true;
+	}
+
+
+	LuaSourceVersion LuaSourceVersion::get(const char* data, size_t size)
+	{
+		// 64 bit FNV-1a, only computed when the stamp of the file changed.
+		uint64 hash = 14695981039346656037ull;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= static_cast<unsigned char>(data[i]);
+			hash *= 1099511628211ull;
+		}
+		return { static_cast<uint64>(size), hash };
+	}
+
+
+	LuaBytecodeCache::Bytecode LuaBytecodeCache::find(const std::string& path, const LuaSourceVersion& version) const
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		auto it = mEntries.find(path);
+		if (it == mEntries.end() || it->second.mVersion != version)
+			return nullptr;
+		return it->second.mBytecode;
+	}
+
+
+	void LuaBytecodeCache::store(const std::string& path, const LuaSourceVersion& version, Bytecode bytecode)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		Entry& entry = mEntries[path];
+		entry.mVersion = version;
+		entry.mBytecode = std::move(bytecode);
+	}
+
+
+	void LuaBytecodeCache::addUser(const std::string& path)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mEntries[path].mUsers++;
+	}
+
+
+	void LuaBytecodeCache::removeUser(const std::string& path)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		auto it = mEntries.find(path);
+		if (it == mEntries.end())
+			return;
+
+		// The last user keeps its own compiled function, it only compiles again from a changed file, which the chunk doesn't help with.
+		Entry& entry = it->second;
+		if (--entry.mUsers <= 0)
+		{
+			mEntries.erase(it);
+			return;
+		}
+		if (entry.mUsers == 1)
+			entry.mBytecode = nullptr;
+	}
+
+
+	int LuaBytecodeCache::getUserCount(const std::string& path) const
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		auto it = mEntries.find(path);
+		return it != mEntries.end() ? it->second.mUsers : 0;
+	}
+
+
+	void LuaBytecodeCache::clear()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (auto& entry : mEntries)
+			entry.second.mBytecode = nullptr;
+	}
+
+}
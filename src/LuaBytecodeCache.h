@@ -0,0 +1,122 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <utility/dllexport.h>
+#include <nap/numeric.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace nap
+{
+
+	/**
+	 * Size and modification time of a file, read without opening it.
+	 * A file whose stamp didn't change isn't read and hashed again. On file systems with a coarse time resolution,
+	 * a save of the same size within the resolution of the previous one is only picked up once the file changes again.
+	 */
+	struct NAPAPI LuaFileStamp
+	{
+		uint64 mSize = 0;
+		int64 mModified = 0;	///< Modification time in ticks of the file system clock
+
+		/**
+		 * @param path the file
+		 * @param stamp receives the stamp of the file
+		 * @return whether the stamp was read
+		 */
+		static bool get(const std::string& path, LuaFileStamp& stamp);
+
+		bool operator==(const LuaFileStamp& other) const { return mSize == other.mSize && mModified == other.mModified; }
+		bool operator!=(const LuaFileStamp& other) const { return !(*this == other); }
+	};
+
+
+	/**
+	 * Identifies the contents of a script file by its size and a hash of its bytes.
+	 * Saving a file without changing it, or touching it, keeps the version: the file is not compiled again.
+	 */
+	struct NAPAPI LuaSourceVersion
+	{
+		uint64 mSize = 0;
+		uint64 mHash = 0;
+
+		/**
+		 * @param data the contents of the file
+		 * @param size size of the contents in bytes
+		 * @return the version of the given contents
+		 */
+		static LuaSourceVersion get(const char* data, size_t size);
+
+		bool operator==(const LuaSourceVersion& other) const { return mSize == other.mSize && mHash == other.mHash; }
+		bool operator!=(const LuaSourceVersion& other) const { return !(*this == other); }
+	};
+
+
+	/**
+	 * Precompiled chunks of script files, shared by all scripts of the LuaService, so a file that is loaded into many states is only parsed once.
+	 * An entry is only used while the contents of the file match the version it was compiled from. Scripts register as users of their file:
+	 * a chunk is only kept while more than one script uses the file, and the entry is removed when its last user is destroyed. Thread safe.
+	 */
+	class NAPAPI LuaBytecodeCache final
+	{
+	public:
+		using Bytecode = std::shared_ptr<const std::vector<char>>;
+
+		/**
+		 * @param path the script file
+		 * @param version current version of the file
+		 * @return the precompiled chunk of the file, nullptr when it is not cached or compiled from another version of the file
+		 */
+		Bytecode find(const std::string& path, const LuaSourceVersion& version) const;
+
+		/**
+		 * Stores the precompiled chunk of a file, replacing the chunk of an older version.
+		 * @param path the script file
+		 * @param version version of the file the chunk was compiled from
+		 * @param bytecode the precompiled chunk
+		 */
+		void store(const std::string& path, const LuaSourceVersion& version, Bytecode bytecode);
+
+		/**
+		 * Registers a script that loads the given file.
+		 * @param path the script file
+		 */
+		void addUser(const std::string& path);
+
+		/**
+		 * Unregisters a script that loaded the given file. The chunk is dropped when at most one user is left, the entry when none is.
+		 * @param path the script file
+		 */
+		void removeUser(const std::string& path);
+
+		/**
+		 * @param path the script file
+		 * @return number of scripts that load the file
+		 */
+		int getUserCount(const std::string& path) const;
+
+		/**
+		 * Removes all chunks, the users stay registered.
+		 */
+		void clear();
+
+	private:
+		struct Entry
+		{
+			int mUsers = 0;
+			LuaSourceVersion mVersion;
+			Bytecode mBytecode;
+		};
+
+		mutable std::mutex mMutex;
+		std::unordered_map<std::string, Entry> mEntries;
+	};
+
+}
@@ -0,0 +1,91 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "LuaCallQueue.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace nap
+{
+
+	void LuaCallQueue::init(int capacity)
+	{
+		size_t size = 1;
+		while (size < static_cast<size_t>(std::max(capacity, 1)))
+			size <<= 1;
+
+		// Slot i is free for the producer that claims write position i.
+		mSlots = std::make_unique<Slot[]>(size);
+		for (size_t i = 0; i < size; i++)
+			mSlots[i].mSequence.store(i, std::memory_order_relaxed);
+		mMask = size - 1;
+		mWritePosition.store(0, std::memory_order_relaxed);
+		mReadPosition = 0;
+	}
+
+
+	bool LuaCallQueue::push(const char* function, const LuaValue* arguments, int count)
+	{
+		size_t name_length = std::strlen(function);
+		if (mSlots == nullptr || name_length > sMaxNameLength || count > sMaxArguments)
+		{
+			mDropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		// Claim a write position whose slot has been read.
+		Slot* slot = nullptr;
+		size_t position = mWritePosition.load(std::memory_order_relaxed);
+		while (true)
+		{
+			slot = &mSlots[position & mMask];
+			size_t sequence = slot->mSequence.load(std::memory_order_acquire);
+			auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+			if (difference == 0)
+			{
+				if (mWritePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (difference < 0)
+			{
+				// The slot still holds a call from the previous lap: full.
+				mDropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			else
+			{
+				position = mWritePosition.load(std::memory_order_relaxed);
+			}
+		}
+
+		Call& call = slot->mCall;
+		std::memcpy(call.mFunction, function, name_length + 1);
+		call.mArgumentCount = count;
+		std::copy(arguments, arguments + count, call.mArguments);
+
+		// Publish the call to the consumer.
+		slot->mSequence.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+
+	bool LuaCallQueue::pop(Call& outCall)
+	{
+		if (mSlots == nullptr)
+			return false;
+
+		Slot& slot = mSlots[mReadPosition & mMask];
+		if (slot.mSequence.load(std::memory_order_acquire) != mReadPosition + 1)
+			return false;
+
+		outCall = slot.mCall;
+
+		// Free the slot for the producer of the next lap.
+		slot.mSequence.store(mReadPosition + mMask + 1, std::memory_order_release);
+		mReadPosition++;
+		return true;
+	}
+
+}
@@ -0,0 +1,94 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include "LuaValue.h"
+
+#include <utility/dllexport.h>
+#include <nap/numeric.h>
+
+#include <atomic>
+#include <initializer_list>
+#include <memory>
+
+namespace nap
+{
+
+	/**
+	 * Bounded lock-free queue of calls into a Lua state: any number of threads push, the thread that owns the state pops.
+	 * Calls are stored by value in preallocated slots, pushing doesn't allocate or block. When the queue is full the call is dropped.
+	 * A bounded multi-producer ring in which every slot has a sequence number that tells whether it is free, written or read.
+	 */
+	class NAPAPI LuaCallQueue final
+	{
+	public:
+		static constexpr int sMaxNameLength = 31;
+		static constexpr int sMaxArguments = 4;
+
+		/**
+		 * A queued call: the name of the function and its arguments.
+		 */
+		struct Call
+		{
+			char mFunction[sMaxNameLength + 1] = { 0 };
+			int mArgumentCount = 0;
+			LuaValue mArguments[sMaxArguments];
+		};
+
+		/**
+		 * Allocates the slots, not thread safe.
+		 * @param capacity maximum number of queued calls, rounded up to a power of two
+		 */
+		void init(int capacity);
+
+		/**
+		 * @return the number of slots, 0 when not initialised
+		 */
+		int getCapacity() const { return mSlots != nullptr ? static_cast<int>(mMask + 1) : 0; }
+
+		/**
+		 * Queues a call, from any thread.
+		 * @param function name of the function, at most sMaxNameLength characters
+		 * @param arguments at most sMaxArguments arguments
+		 * @return whether the call was queued, false when the queue is full, the name too long or there are too many arguments
+		 */
+		bool push(const char* function, std::initializer_list<LuaValue> arguments) { return push(function, arguments.begin(), static_cast<int>(arguments.size())); }
+
+		/**
+		 * Queues a call, from any thread.
+		 * @param function name of the function, at most sMaxNameLength characters
+		 * @param arguments array of 'count' arguments
+		 * @param count number of arguments, at most sMaxArguments
+		 * @return whether the call was queued, false when the queue is full, the name too long or there are too many arguments
+		 */
+		bool push(const char* function, const LuaValue* arguments, int count);
+
+		/**
+		 * Takes the oldest call from the queue, only from the owning thread.
+		 * @param outCall the call
+		 * @return whether there was a call
+		 */
+		bool pop(Call& outCall);
+
+		/**
+		 * @return number of calls that were dropped because they didn't fit in the queue
+		 */
+		uint64 getDroppedCount() const { return mDropped.load(std::memory_order_relaxed); }
+
+	private:
+		struct Slot
+		{
+			std::atomic<size_t> mSequence { 0 };
+			Call mCall;
+		};
+
+		std::unique_ptr<Slot[]> mSlots;
+		size_t mMask = 0;
+		alignas(64) std::atomic<size_t> mWritePosition { 0 };	///< Claimed by producers
+		alignas(64) size_t mReadPosition = 0;					///< Only used by the consumer
+		std::atomic<uint64> mDropped { 0 };
+	};
+
+}
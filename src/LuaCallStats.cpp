@@ -0,0 +1,173 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "LuaCallStats.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _MSC_VER
+	#include <intrin.h>
+#endif
+
+namespace nap
+{
+
+	// Single writer: a relaxed load and store is enough and avoids a locked read-modify-write.
+	static void add(std::atomic<uint64>& value, uint64 amount)
+	{
+		value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+	}
+
+
+	static int getHighestBit(uint64 value)
+	{
+#ifdef _MSC_VER
+		unsigned long bit = 0;
+		_BitScanReverse64(&bit, value);
+		return static_cast<int>(bit);
+#else
+		return 63 - __builtin_clzll(value);
+#endif
+	}
+
+
+	void LuaCallStats::setEnabled(bool enabled)
+	{
+		if (enabled && mHistograms == nullptr)
+			mHistograms = std::make_unique<Histogram[]>(sMaxFunctions);
+		mEnabled = enabled;
+	}
+
+
+	int LuaCallStats::getIndex(const std::string& name)
+	{
+		if (mHistograms == nullptr)
+			return -1;
+
+		// Names are compared as stored, truncated names share a histogram.
+		int count = mHistogramCount.load(std::memory_order_relaxed);
+		for (int i = 0; i < count; i++)
+			if (std::strncmp(mHistograms[i].mName, name.c_str(), sMaxNameLength) == 0)
+				return i;
+		if (count >= sMaxFunctions)
+			return -1;
+
+		// A new histogram is published once it is named.
+		std::strncpy(mHistograms[count].mName, name.c_str(), sMaxNameLength);
+		mHistogramCount.store(count + 1, std::memory_order_release);
+		return count;
+	}
+
+
+	void LuaCallStats::record(int index, uint64 nanoseconds)
+	{
+		if (index < 0)
+			return;
+
+		Histogram& histogram = mHistograms[index];
+		add(histogram.mCount, 1);
+		add(histogram.mTotal, nanoseconds);
+		add(histogram.mFrameCount, 1);
+		add(histogram.mBuckets[getBucket(nanoseconds)], 1);
+		if (nanoseconds > histogram.mMax.load(std::memory_order_relaxed))
+			histogram.mMax.store(nanoseconds, std::memory_order_relaxed);
+	}
+
+
+	void LuaCallStats::nextFrame()
+	{
+		int count = mHistogramCount.load(std::memory_order_relaxed);
+		for (int i = 0; i < count; i++)
+		{
+			Histogram& histogram = mHistograms[i];
+			histogram.mLastFrameCount.store(histogram.mFrameCount.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			histogram.mFrameCount.store(0, std::memory_order_relaxed);
+		}
+	}
+
+
+	void LuaCallStats::clear()
+	{
+		int count = mHistogramCount.load(std::memory_order_relaxed);
+		for (int i = 0; i < count; i++)
+		{
+			Histogram& histogram = mHistograms[i];
+			histogram.mCount.store(0, std::memory_order_relaxed);
+			histogram.mTotal.store(0, std::memory_order_relaxed);
+			histogram.mMax.store(0, std::memory_order_relaxed);
+			histogram.mFrameCount.store(0, std::memory_order_relaxed);
+			histogram.mLastFrameCount.store(0, std::memory_order_relaxed);
+			for (auto& bucket : histogram.mBuckets)
+				bucket.store(0, std::memory_order_relaxed);
+		}
+	}
+
+
+	std::vector<LuaCallStats::Summary> LuaCallStats::getSummaries() const
+	{
+		std::vector<Summary> summaries;
+		int count = mHistogramCount.load(std::memory_order_acquire);
+		summaries.reserve(count);
+		for (int i = 0; i < count; i++)
+		{
+			const Histogram& histogram = mHistograms[i];
+			Summary summary;
+			summary.mName = histogram.mName;
+			summary.mCount = histogram.mCount.load(std::memory_order_relaxed);
+			summary.mLastFrameCount = histogram.mLastFrameCount.load(std::memory_order_relaxed);
+			summary.mMax = histogram.mMax.load(std::memory_order_relaxed) * 1e-9;
+			if (summary.mCount > 0)
+			{
+				summary.mMean = histogram.mTotal.load(std::memory_order_relaxed) * 1e-9 / summary.mCount;
+				summary.mP50 = std::min(getPercentile(histogram, summary.mCount, 0.5), summary.mMax);
+				summary.mP99 = std::min(getPercentile(histogram, summary.mCount, 0.99), summary.mMax);
+			}
+			summaries.emplace_back(std::move(summary));
+		}
+		return summaries;
+	}
+
+
+	int LuaCallStats::getBucket(uint64 nanoseconds)
+	{
+		// Values below the sub bucket count have a bucket each.
+		if (nanoseconds < sSubBuckets)
+			return static_cast<int>(nanoseconds);
+
+		// Above that, every power of two is split into linear sub buckets.
+		nanoseconds = std::min<uint64>(nanoseconds, (uint64(1) << sMaxExponent) - 1);
+		int exponent = getHighestBit(nanoseconds);
+		int sub_bucket = static_cast<int>(nanoseconds >> (exponent - 3)) & (sSubBuckets - 1);
+		return (exponent - 2) * sSubBuckets + sub_bucket;
+	}
+
+
+	double LuaCallStats::getBucketValue(int bucket)
+	{
+		if (bucket < sSubBuckets)
+			return bucket * 1e-9;
+
+		// Middle of the range covered by the bucket.
+		int exponent = bucket / sSubBuckets + 2;
+		int sub_bucket = bucket % sSubBuckets;
+		double width = static_cast<double>(uint64(1) << (exponent - 3));
+		return ((sSubBuckets + sub_bucket) * width + width * 0.5) * 1e-9;
+	}
+
+
+	double LuaCallStats::getPercentile(const Histogram& histogram, uint64 count, double percentile)
+	{
+		uint64 target = std::max<uint64>(static_cast<uint64>(count * percentile + 0.5), 1);
+		uint64 seen = 0;
+		for (int i = 0; i < sBucketCount; i++)
+		{
+			seen += histogram.mBuckets[i].load(std::memory_order_relaxed);
+			if (seen >= target)
+				return getBucketValue(i);
+		}
+		return getBucketValue(sBucketCount - 1);
+	}
+
+}
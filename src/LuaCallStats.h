@@ -0,0 +1,111 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <utility/dllexport.h>
+#include <nap/numeric.h>
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace nap
+{
+
+	/**
+	 * Latency histograms of the C++ to Lua calls of a single LuaScript, one per called function.
+	 * Histograms are log-linear (HDR style): every power of two is split into 8 linear buckets, so percentiles are accurate to within 12.5%.
+	 * A function is registered once with getIndex(), the owning LuaScript keeps the index next to the function in Lua.
+	 * Recording by index happens on the thread that owns the script and doesn't lock, look up or allocate.
+	 * The statistics can be read from any thread while they are being recorded.
+	 */
+	class NAPAPI LuaCallStats final
+	{
+	public:
+		static constexpr int sMaxFunctions = 128;	///< Calls to functions beyond this number are not recorded.
+		static constexpr int sMaxNameLength = 47;	///< Longer names are truncated.
+		static constexpr int sSubBuckets = 8;		///< Linear buckets per power of two.
+		static constexpr int sMaxExponent = 40;		///< Durations are clamped to 2^40 nanoseconds (~18 minutes).
+		static constexpr int sBucketCount = (sMaxExponent - 2) * sSubBuckets;
+
+		/**
+		 * Snapshot of the statistics of a single function. Durations are in seconds.
+		 */
+		struct Summary
+		{
+			std::string mName;				///< Name of the called function
+			uint64 mCount = 0;				///< Total number of calls
+			uint64 mLastFrameCount = 0;		///< Number of calls in the previous frame
+			double mMean = 0.0;				///< Average duration
+			double mP50 = 0.0;				///< Median duration
+			double mP99 = 0.0;				///< 99th percentile duration
+			double mMax = 0.0;				///< Longest duration
+		};
+
+		/**
+		 * Enables or disables recording. The histograms are allocated the first time recording is enabled.
+		 */
+		void setEnabled(bool enabled);
+
+		/**
+		 * @return whether calls are recorded
+		 */
+		bool isEnabled() const { return mEnabled; }
+
+		/**
+		 * Finds or adds the histogram of a function. Searches the names of all histograms, so the caller keeps the index.
+		 * Called by the owning thread, doesn't allocate.
+		 * @param name name of the called function
+		 * @return index of the histogram, -1 when recording was never enabled or there are sMaxFunctions histograms already
+		 */
+		int getIndex(const std::string& name);
+
+		/**
+		 * Records the duration of a call. Called by the owning LuaScript.
+		 * @param index index of the histogram of the called function, returned by getIndex(), ignored when negative
+		 * @param nanoseconds duration of the call
+		 */
+		void record(int index, uint64 nanoseconds);
+
+		/**
+		 * Marks the start of a new frame, the number of calls in the frame that ended is stored as the last frame count.
+		 * Called by the owning thread.
+		 */
+		void nextFrame();
+
+		/**
+		 * Resets all statistics. Called by the owning thread.
+		 */
+		void clear();
+
+		/**
+		 * @return a snapshot of the statistics of all called functions, safe to call from any thread
+		 */
+		std::vector<Summary> getSummaries() const;
+
+	private:
+		struct Histogram
+		{
+			char mName[sMaxNameLength + 1] = {};
+			std::atomic<uint64> mCount = 0;
+			std::atomic<uint64> mTotal = 0;
+			std::atomic<uint64> mMax = 0;
+			std::atomic<uint64> mFrameCount = 0;
+			std::atomic<uint64> mLastFrameCount = 0;
+			std::array<std::atomic<uint64>, sBucketCount> mBuckets = {};
+		};
+
+		static int getBucket(uint64 nanoseconds);
+		static double getBucketValue(int bucket);
+		static double getPercentile(const Histogram& histogram, uint64 count, double percentile);
+
+		bool mEnabled = false;
+		std::unique_ptr<Histogram[]> mHistograms;			///< Fixed storage, so readers never see it move.
+		std::atomic<int> mHistogramCount = 0;				///< Number of histograms in use, published after a histogram is named.
+	};
+
+}
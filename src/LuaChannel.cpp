@@ -0,0 +1,161 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "LuaChannel.h"
+#include "LuaSerialize.h"
+#include "LuaService.h"
+
+#include <cstring>
+
+RTTI_BEGIN_CLASS_NO_DEFAULT_CONSTRUCTOR(nap::LuaChannel)
+	RTTI_CONSTRUCTOR(nap::LuaService&)
+RTTI_END_CLASS
+
+namespace nap
+{
+
+	namespace
+	{
+		const char* sEndpointMetatable = "nap.LuaChannel";
+
+		/**
+		 * Buffer a message is serialised into before it is appended to a channel, reused by every send on the thread.
+		 */
+		std::vector<char>& getScratchBuffer()
+		{
+			static thread_local std::vector<char> buffer;
+			buffer.clear();
+			return buffer;
+		}
+	}
+
+
+	LuaChannel::LuaChannel(LuaService& service) :
+		mService(service)
+	{ }
+
+
+	bool LuaChannel::init(utility::ErrorState& errorState)
+	{
+		mService.registerChannel(*this);
+		return true;
+	}
+
+
+	void LuaChannel::onDestroy()
+	{
+		mService.unregisterChannel(*this);
+	}
+
+
+	void LuaChannel::send(const LuaValue& value)
+	{
+		auto& buffer = getScratchBuffer();
+		luaserialize::write(value, buffer);
+		send(buffer.data(), buffer.size());
+	}
+
+
+	void LuaChannel::send(const char* data, size_t size)
+	{
+		auto message_size = static_cast<uint32>(size);
+		const char* size_bytes = reinterpret_cast<const char*>(&message_size);
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		mWriteBuffer.insert(mWriteBuffer.end(), size_bytes, size_bytes + sizeof(uint32));
+		mWriteBuffer.insert(mWriteBuffer.end(), data, data + size);
+		mWriteCount++;
+	}
+
+
+	void LuaChannel::publish()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		std::swap(mReadBuffer, mWriteBuffer);
+		mReadCount = mWriteCount;
+		mWriteBuffer.clear();
+		mWriteCount = 0;
+		mBatch++;
+	}
+
+
+	void LuaChannel::addTo(lua_State* L)
+	{
+		auto* endpoint = static_cast<Endpoint*>(lua_newuserdata(L, sizeof(Endpoint)));
+		new (endpoint) Endpoint();
+		endpoint->mChannel = this;
+
+		// The metatable is shared by the endpoints of all channels in the state.
+		if (luaL_newmetatable(L, sEndpointMetatable) != 0)
+		{
+			lua_newtable(L);
+			lua_pushcfunction(L, &LuaChannel::send);
+			lua_setfield(L, -2, "send");
+			lua_pushcfunction(L, &LuaChannel::receive);
+			lua_setfield(L, -2, "receive");
+			lua_pushcfunction(L, &LuaChannel::count);
+			lua_setfield(L, -2, "count");
+			lua_setfield(L, -2, "__index");
+			lua_pushboolean(L, 0);
+			lua_setfield(L, -2, "__metatable");
+		}
+		lua_setmetatable(L, -2);
+		lua_setfield(L, -2, mID.c_str());
+	}
+
+
+	int LuaChannel::send(lua_State* L)
+	{
+		auto* endpoint = static_cast<Endpoint*>(luaL_checkudata(L, 1, sEndpointMetatable));
+		if (lua_isnoneornil(L, 2))
+			return luaL_error(L, "channel '%s': can't send nil", endpoint->mChannel->mID.c_str());
+
+		// The buffer is thread local, so no destructor is skipped when the error unwinds the stack.
+		auto& buffer = getScratchBuffer();
+		const char* error = luaserialize::write(L, 2, buffer);
+		if (error != nullptr)
+			return luaL_error(L, "channel '%s': %s", endpoint->mChannel->mID.c_str(), error);
+
+		endpoint->mChannel->send(buffer.data(), buffer.size());
+		return 0;
+	}
+
+
+	int LuaChannel::receive(lua_State* L)
+	{
+		auto* endpoint = static_cast<Endpoint*>(luaL_checkudata(L, 1, sEndpointMetatable));
+		LuaChannel& channel = *endpoint->mChannel;
+
+		// The batch is only replaced between frames, a state that sees a new batch starts reading at its beginning.
+		if (endpoint->mBatch != channel.mBatch)
+		{
+			endpoint->mBatch = channel.mBatch;
+			endpoint->mPosition = 0;
+		}
+
+		const std::vector<char>& batch = channel.mReadBuffer;
+		if (endpoint->mPosition + sizeof(uint32) > batch.size())
+		{
+			lua_pushnil(L);
+			return 1;
+		}
+
+		uint32 size = 0;
+		std::memcpy(&size, batch.data() + endpoint->mPosition, sizeof(uint32));
+		const char* data = batch.data() + endpoint->mPosition + sizeof(uint32);
+		endpoint->mPosition += sizeof(uint32) + size;
+		if (!luaserialize::read(L, data, size))
+			return luaL_error(L, "channel '%s': malformed message", channel.mID.c_str());
+		return 1;
+	}
+
+
+	int LuaChannel::count(lua_State* L)
+	{
+		auto* endpoint = static_cast<Endpoint*>(luaL_checkudata(L, 1, sEndpointMetatable));
+		lua_pushinteger(L, endpoint->mChannel->mReadCount);
+		return 1;
+	}
+
+}
@@ -0,0 +1,101 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include "LuaCompat.h"
+#include "LuaValue.h"
+
+#include <nap/resource.h>
+#include <nap/numeric.h>
+
+#include <mutex>
+#include <vector>
+
+namespace nap
+{
+
+	class LuaService;
+
+	/**
+	 * Passes messages between Lua states, also across threads. A message is a Lua value, including nested tables, serialised into a compact binary format.
+	 * Messages sent during a frame are appended to a single buffer. At the start of the next frame the LuaService publishes them as a batch,
+	 * which every script that uses the channel reads and deserialises directly into its own state.
+	 * The two buffers are swapped and reused, so sending doesn't allocate once they have grown to the size of a batch.
+	 *
+	 * Scripts list the channels they use in their 'Channels' property and find them in the global 'channels' table, by ID:
+	 *
+	 *	channels.events:send({ kind = "hit", position = { 1, 2, 3 } })
+	 *	for message in channels.events.receive, channels.events do ... end
+	 *
+	 * Every script reads the whole batch of the previous frame, receive() returns nil after the last message.
+	 */
+	class NAPAPI LuaChannel : public Resource
+	{
+		RTTI_ENABLE(Resource)
+
+	public:
+		LuaChannel(LuaService& service);
+
+		bool init(utility::ErrorState& errorState) override;
+
+		void onDestroy() override;
+
+		/**
+		 * Sends a value from C++, from any thread.
+		 * @param value the message
+		 */
+		void send(const LuaValue& value);
+
+		/**
+		 * Sends a serialised message, from any thread.
+		 * @param data the message, serialised with luaserialize::write()
+		 * @param size size of the message in bytes
+		 */
+		void send(const char* data, size_t size);
+
+		/**
+		 * @return number of messages in the published batch
+		 */
+		int getMessageCount() const { return mReadCount; }
+
+		/**
+		 * Publishes the messages sent since the previous call as the new batch. Called by the LuaService at the start of every frame,
+		 * when no script reads the channel.
+		 */
+		void publish();
+
+		/**
+		 * Adds the end of the channel to the table on top of the stack, under the ID of the channel.
+		 * @param L the Lua state
+		 */
+		void addTo(lua_State* L);
+
+	private:
+		/**
+		 * The end of a channel in a Lua state, keeps the position of the state in the published batch.
+		 */
+		struct Endpoint
+		{
+			LuaChannel* mChannel = nullptr;
+			uint64 mBatch = 0;		///< Batch the position belongs to
+			size_t mPosition = 0;	///< Offset of the next message in the batch
+		};
+
+		static int send(lua_State* L);
+		static int receive(lua_State* L);
+		static int count(lua_State* L);
+
+		LuaService& mService;
+
+		std::mutex mMutex;
+		std::vector<char> mWriteBuffer;		///< Messages sent this frame, each preceded by its size
+		int mWriteCount = 0;
+
+		std::vector<char> mReadBuffer;		///< The published batch
+		int mReadCount = 0;
+		uint64 mBatch = 0;					///< Number of the published batch
+	};
+
+}
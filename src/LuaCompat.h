@@ -0,0 +1,254 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+// Includes the headers of the Lua implementation selected with NAPLUA_LUA_BACKEND and hides the differences between their C APIs.
+// Has to be included before LuaBridge, which detects LuaJIT from its headers.
+
+extern "C" {
+	#include <lua.h>
+	#include <lualib.h>
+	#include <lauxlib.h>
+#if defined(NAPLUA_LUAJIT)
+	#include <luajit.h>
+#endif
+}
+
+// Lua 5.1 (LuaJIT) has no status code for success and no global table index.
+#if LUA_VERSION_NUM < 502
+	#ifndef LUA_OK
+		#define LUA_OK 0
+	#endif
+	#ifndef lua_pushglobaltable
+		#define lua_pushglobaltable(L) lua_pushvalue(L, LUA_GLOBALSINDEX)
+	#endif
+#endif
+
+namespace nap
+{
+	namespace luacompat
+	{
+		/**
+		 * @return the name and version of the Lua implementation the module is built against
+		 */
+		inline const char* getVersion()
+		{
+#if defined(LUAJIT_VERSION)
+			return LUAJIT_VERSION;
+#else
+			return LUA_RELEASE;
+#endif
+		}
+
+		/**
+		 * Lua 5.4 runs a full emergency collection when an allocation fails, also while the collector is stopped.
+		 * @return whether a failed allocation only raises a memory error, without collecting garbage first
+		 */
+		inline bool failsAllocationsWithoutCollecting()
+		{
+#if LUA_VERSION_NUM >= 504
+			return false;
+#else
+			return true;
+#endif
+		}
+
+		/**
+		 * Creates a state that allocates through 'allocator'.
+		 * LuaJIT builds without 64 bit GC references don't support custom allocators, the state then uses the default allocator.
+		 * @return the new state, nullptr on failure
+		 */
+		inline lua_State* newState(lua_Alloc allocator, void* userData)
+		{
+			lua_State* L = lua_newstate(allocator, userData);
+#if defined(LUAJIT_VERSION)
+			if (L == nullptr)
+				L = luaL_newstate();
+#endif
+			return L;
+		}
+
+		/**
+		 * Loads a chunk, text or precompiled.
+		 */
+		inline int load(lua_State* L, lua_Reader reader, void* data, const char* chunkName)
+		{
+#if defined(LUAJIT_VERSION)
+			return lua_loadx(L, reader, data, chunkName, nullptr);
+#elif LUA_VERSION_NUM < 502
+			return lua_load(L, reader, data, chunkName);
+#else
+			return lua_load(L, reader, data, chunkName, nullptr);
+#endif
+		}
+
+		/**
+		 * Writes the function on top of the stack as a precompiled chunk, including debug information.
+		 */
+		inline int dump(lua_State* L, lua_Writer writer, void* data)
+		{
+#if LUA_VERSION_NUM >= 503
+			return lua_dump(L, writer, data, 0);
+#else
+			return lua_dump(L, writer, data);
+#endif
+		}
+
+		/**
+		 * @return the stack index 'index' as an index from the bottom of the stack, pseudo indices are returned unchanged
+		 */
+		inline int absIndex(lua_State* L, int index)
+		{
+#if LUA_VERSION_NUM < 502
+			return index > 0 || index <= LUA_REGISTRYINDEX ? index : lua_gettop(L) + index + 1;
+#else
+			return lua_absindex(L, index);
+#endif
+		}
+
+		/**
+		 * @return the length of the table or string at 'index' without invoking metamethods
+		 */
+		inline size_t rawLength(lua_State* L, int index)
+		{
+#if LUA_VERSION_NUM < 502
+			return lua_objlen(L, index);
+#else
+			return lua_rawlen(L, index);
+#endif
+		}
+
+		/**
+		 * @return whether the value at 'index' is a number of the integer subtype, always false before Lua 5.3
+		 */
+		inline bool isInteger(lua_State* L, int index)
+		{
+#if LUA_VERSION_NUM >= 503
+			return lua_isinteger(L, index) != 0;
+#else
+			return false;
+#endif
+		}
+
+		/**
+		 * @return whether the running coroutine can yield. Always true before Lua 5.3, where lua_yield() raises the error itself.
+		 */
+		inline bool isYieldable(lua_State* L)
+		{
+#if LUA_VERSION_NUM >= 503
+			return lua_isyieldable(L) != 0;
+#else
+			return true;
+#endif
+		}
+
+		/**
+		 * Starts or continues the coroutine 'thread', with 'argumentCount' arguments on top of its stack.
+		 * @param from the state that resumes the coroutine, not used by Lua 5.1
+		 * @param outResultCount number of values the coroutine yielded or returned, on top of its stack
+		 * @return LUA_YIELD when the coroutine yielded, LUA_OK when it finished, an error code otherwise
+		 */
+		inline int resume(lua_State* thread, lua_State* from, int argumentCount, int& outResultCount)
+		{
+#if LUA_VERSION_NUM >= 504
+			return lua_resume(thread, from, argumentCount, &outResultCount);
+#else
+	#if LUA_VERSION_NUM >= 502
+			int status = lua_resume(thread, from, argumentCount);
+	#else
+			int status = lua_resume(thread, argumentCount);
+	#endif
+			outResultCount = status == LUA_OK || status == LUA_YIELD ? lua_gettop(thread) : 0;
+			return status;
+#endif
+		}
+
+		/**
+		 * Pops a table from the stack and makes it the global environment of the function at 'index', counted with the table on the stack.
+		 */
+		inline void setEnvironment(lua_State* L, int index)
+		{
+#if LUA_VERSION_NUM < 502
+			lua_setfenv(L, index);
+#else
+			// The environment of a main chunk is its first upvalue, _ENV.
+			lua_setupvalue(L, index, 1);
+#endif
+		}
+
+		/**
+		 * Switches the collector to incremental mode.
+		 * @param pause percentage the memory grows after a collection before a new cycle starts, 0 to keep the current value
+		 * @param stepMultiplier speed of the collector relative to allocation in percent, 0 to keep the current value
+		 */
+		inline void setIncrementalGC(lua_State* L, int pause, int stepMultiplier)
+		{
+#if LUA_VERSION_NUM >= 504
+			lua_gc(L, LUA_GCINC, pause, stepMultiplier, 0);
+#else
+	#if LUA_VERSION_NUM == 502
+			lua_gc(L, LUA_GCINC, 0);
+	#endif
+			if (pause > 0)
+				lua_gc(L, LUA_GCSETPAUSE, pause);
+			if (stepMultiplier > 0)
+				lua_gc(L, LUA_GCSETSTEPMUL, stepMultiplier);
+#endif
+		}
+
+		/**
+		 * Switches the collector to generational mode.
+		 * @param minorMultiplier percentage the memory grows before a minor collection, 0 to keep the current value. Only used by Lua 5.4.
+		 * @param majorMultiplier percentage the memory grows beyond the last major collection before a new one, 0 to keep the current value
+		 * @return false when the implementation has no generational mode
+		 */
+		inline bool setGenerationalGC(lua_State* L, int minorMultiplier, int majorMultiplier)
+		{
+#if LUA_VERSION_NUM >= 504
+			lua_gc(L, LUA_GCGEN, minorMultiplier, majorMultiplier);
+			return true;
+#elif LUA_VERSION_NUM == 502
+			// The experimental generational mode of Lua 5.2 has no minor collection threshold.
+			lua_gc(L, LUA_GCGEN, 0);
+			if (majorMultiplier > 0)
+				lua_gc(L, LUA_GCSETMAJORINC, majorMultiplier);
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		/**
+		 * Pushes t[p] onto the stack, where t is the table at 'index' and p a light userdata key.
+		 */
+		inline void rawGetPointer(lua_State* L, int index, const void* p)
+		{
+#if LUA_VERSION_NUM < 502
+			if (index < 0 && index > LUA_REGISTRYINDEX)
+				index = lua_gettop(L) + index + 1;
+			lua_pushlightuserdata(L, const_cast<void*>(p));
+			lua_rawget(L, index);
+#else
+			lua_rawgetp(L, index, p);
+#endif
+		}
+
+		/**
+		 * Pops a value from the stack and stores it as t[p], where t is the table at 'index' and p a light userdata key.
+		 */
+		inline void rawSetPointer(lua_State* L, int index, const void* p)
+		{
+#if LUA_VERSION_NUM < 502
+			if (index < 0 && index > LUA_REGISTRYINDEX)
+				index = lua_gettop(L) + index + 1;
+			lua_pushlightuserdata(L, const_cast<void*>(p));
+			lua_insert(L, -2);
+			lua_rawset(L, index);
+#else
+			lua_rawsetp(L, index, p);
+#endif
+		}
+	}
+}
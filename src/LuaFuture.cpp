@@ -0,0 +1,53 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "LuaFuture.h"
+
+#include <exception>
+
+namespace nap
+{
+
+	void LuaFuture::run(const Work& work)
+	{
+		try
+		{
+			mResults = work();
+		}
+		catch (const std::exception& e)
+		{
+			mError = e.what();
+			if (mError.empty())
+				mError = "the work of the future threw an exception";
+		}
+		catch (...)
+		{
+			// An exception escaping the worker thread would terminate the application, and the awaiting task would wait forever.
+			mError = "the work of the future threw an exception";
+		}
+
+		// Publishes the results to the owning thread.
+		mReady.store(true, std::memory_order_release);
+	}
+
+
+	int LuaFuture::pushResults(lua_State* L)
+	{
+		if (!mError.empty() || mTaken)
+		{
+			lua_pushnil(L);
+			lua_pushstring(L, !mError.empty() ? mError.c_str() : "the results of the future were already taken");
+			return 2;
+		}
+
+		// The results are converted once, the C++ data is released afterwards.
+		mTaken = true;
+		if (!mResults)
+			return 0;
+		int count = mResults(L);
+		mResults = nullptr;
+		return count;
+	}
+
+}
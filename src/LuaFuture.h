@@ -0,0 +1,74 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include "LuaCompat.h"
+#include "LuaBridge/LuaBridge.h"
+
+#include <utility/dllexport.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace nap
+{
+
+	/**
+	 * Result of C++ work that runs on a worker thread, returned to Lua by a bound function and awaited by a task with await(future).
+	 * The work returns a function that pushes its results. That function is called once, on the thread that owns the script, when the awaiting task continues.
+	 * Created with LuaScript::runAsync().
+	 */
+	class NAPAPI LuaFuture final : public std::enable_shared_from_this<LuaFuture>
+	{
+	public:
+		/**
+		 * Pushes the results of the work on the stack and returns their number.
+		 */
+		using Results = std::function<int(lua_State*)>;
+
+		/**
+		 * The work, returns the function that pushes its results.
+		 */
+		using Work = std::function<Results()>;
+
+		/**
+		 * Creates results of a single value of a type LuaBridge can push. The value is moved into the results and converted to Lua when the task continues.
+		 * @param value the result of the work
+		 * @return the results
+		 */
+		template <typename T>
+		static Results makeResults(T value)
+		{
+			return [value = std::move(value)](lua_State* L) { return luabridge::push(L, value) ? 1 : 0; };
+		}
+
+		/**
+		 * @return whether the work is done
+		 */
+		bool isReady() const { return mReady.load(std::memory_order_acquire); }
+
+		/**
+		 * Runs the work and stores its results, or its error when it throws. Called on the worker thread.
+		 * @param work the work
+		 */
+		void run(const Work& work);
+
+		/**
+		 * Pushes the results of the finished work, or nil and the error when the work failed. The results are only pushed the first time.
+		 * @param L the state or coroutine that receives the results
+		 * @return the number of pushed values
+		 */
+		int pushResults(lua_State* L);
+
+	private:
+		std::atomic<bool> mReady = { false };
+		Results mResults;
+		std::string mError;
+		bool mTaken = false;
+	};
+
+}
@@ -0,0 +1,153 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "LuaInputRouter.h"
+#include "LuaScript.h"
+
+#include <inputevent.h>
+
+#include <new>
+
+namespace nap
+{
+
+	namespace
+	{
+		const char* sMetatableName = "nap.LuaInputEventView";
+
+		// Names of the event types in Lua, in the order of ELuaInputEventType.
+		const char* sTypeNames[] = { "keyPress", "keyRelease", "pointerPress", "pointerRelease", "pointerMove", "wheel" };
+
+
+		LuaInputEventView& toView(lua_State* L)
+		{
+			return *static_cast<LuaInputEventView*>(luaL_checkudata(L, 1, sMetatableName));
+		}
+
+
+		int get(lua_State* L)
+		{
+			LuaInputEventView& view = toView(L);
+			lua_Integer i = luaL_checkinteger(L, 2);
+			if (i < 1 || i > view.mCount)
+				return luaL_error(L, "event index %d out of range 1-%d", static_cast<int>(i), view.mCount);
+
+			const LuaInputEvent& event = view.mEvents[i - 1];
+			lua_pushstring(L, sTypeNames[static_cast<int>(event.mType)]);
+			lua_pushinteger(L, event.mKey);
+			lua_pushnumber(L, event.mX);
+			lua_pushnumber(L, event.mY);
+			lua_pushinteger(L, event.mWindow);
+			return 5;
+		}
+
+
+		int length(lua_State* L)
+		{
+			lua_pushinteger(L, toView(L).mCount);
+			return 1;
+		}
+
+
+		/**
+		 * Converts a NAP input event, returns false for events scripts don't receive.
+		 */
+		bool convert(const InputEvent& event, LuaInputEvent& outEvent)
+		{
+			rtti::TypeInfo type = event.get_type();
+			if (type.is_derived_from(RTTI_OF(KeyEvent)))
+			{
+				const auto& key_event = static_cast<const KeyEvent&>(event);
+				outEvent.mType = type.is_derived_from(RTTI_OF(KeyPressEvent)) ? ELuaInputEventType::KeyPress : ELuaInputEventType::KeyRelease;
+				outEvent.mKey = static_cast<int>(key_event.mKey);
+				outEvent.mWindow = key_event.mWindow;
+				return true;
+			}
+
+			if (type.is_derived_from(RTTI_OF(PointerClickEvent)))
+			{
+				const auto& click_event = static_cast<const PointerClickEvent&>(event);
+				outEvent.mType = type.is_derived_from(RTTI_OF(PointerPressEvent)) ? ELuaInputEventType::PointerPress : ELuaInputEventType::PointerRelease;
+				outEvent.mKey = static_cast<int>(click_event.mButton);
+				outEvent.mX = static_cast<float>(click_event.mX);
+				outEvent.mY = static_cast<float>(click_event.mY);
+				outEvent.mWindow = click_event.mWindow;
+				return true;
+			}
+
+			if (type.is_derived_from(RTTI_OF(PointerMoveEvent)))
+			{
+				const auto& move_event = static_cast<const PointerMoveEvent&>(event);
+				outEvent.mType = ELuaInputEventType::PointerMove;
+				outEvent.mX = static_cast<float>(move_event.mX);
+				outEvent.mY = static_cast<float>(move_event.mY);
+				outEvent.mWindow = move_event.mWindow;
+				return true;
+			}
+
+			if (type.is_derived_from(RTTI_OF(MouseWheelEvent)))
+			{
+				const auto& wheel_event = static_cast<const MouseWheelEvent&>(event);
+				outEvent.mType = ELuaInputEventType::Wheel;
+				outEvent.mX = static_cast<float>(wheel_event.mX);
+				outEvent.mY = static_cast<float>(wheel_event.mY);
+				outEvent.mWindow = wheel_event.mWindow;
+				return true;
+			}
+			return false;
+		}
+	}
+
+
+	LuaInputRouter::LuaInputRouter(int capacity, InputRouter* forward) :
+		mCapacity(static_cast<size_t>(capacity)), mForward(forward)
+	{
+		mEvents.reserve(mCapacity);
+	}
+
+
+	void LuaInputRouter::routeEvent(const InputEvent& event, const EntityList& entities)
+	{
+		if (mForward != nullptr)
+			mForward->routeEvent(event, entities);
+
+		LuaInputEvent lua_event;
+		if (!convert(event, lua_event))
+			return;
+
+		if (mEvents.size() < mCapacity)
+			mEvents.emplace_back(lua_event);
+		else
+			mDropped++;
+	}
+
+
+	bool LuaInputRouter::deliver(LuaScript& script, utility::ErrorState& errorState, const std::string& handler)
+	{
+		if (mEvents.empty())
+			return true;
+		return script.deliverInput(mEvents.data(), static_cast<int>(mEvents.size()), handler, errorState);
+	}
+
+
+	LuaInputEventView* LuaInputEventView::push(lua_State* L)
+	{
+		auto* view = new (lua_newuserdata(L, sizeof(LuaInputEventView))) LuaInputEventView();
+
+		if (luaL_newmetatable(L, sMetatableName))
+		{
+			lua_newtable(L);
+			lua_pushcfunction(L, &get);
+			lua_setfield(L, -2, "get");
+			lua_setfield(L, -2, "__index");
+			lua_pushcfunction(L, &length);
+			lua_setfield(L, -2, "__len");
+			lua_pushstring(L, "LuaInputEventView");
+			lua_setfield(L, -2, "__metatable");
+		}
+		lua_setmetatable(L, -2);
+		return view;
+	}
+
+}
@@ -0,0 +1,126 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include "LuaCompat.h"
+
+#include <inputrouter.h>
+#include <nap/numeric.h>
+#include <utility/dllexport.h>
+#include <utility/errorstate.h>
+
+#include <string>
+#include <vector>
+
+namespace nap
+{
+
+	class LuaScript;
+
+	/**
+	 * Kind of a LuaInputEvent, passed to Lua as a string.
+	 */
+	enum class ELuaInputEventType : uint8
+	{
+		KeyPress,		///< "keyPress", the key is the key code
+		KeyRelease,		///< "keyRelease", the key is the key code
+		PointerPress,	///< "pointerPress", the key is the mouse button
+		PointerRelease,	///< "pointerRelease", the key is the mouse button
+		PointerMove,	///< "pointerMove"
+		Wheel			///< "wheel", the position is the scroll distance
+	};
+
+
+	/**
+	 * An input event in the compact form that is passed to scripts.
+	 */
+	struct LuaInputEvent
+	{
+		ELuaInputEventType mType = ELuaInputEventType::KeyPress;
+		int mKey = 0;			///< Key code or mouse button
+		float mX = 0.0f;		///< Pointer position or scroll distance
+		float mY = 0.0f;		///< Pointer position or scroll distance
+		int mWindow = 0;		///< Number of the window that received the event
+	};
+
+
+	/**
+	 * Input router that collects the key, pointer and wheel events of a frame, so a script handles all of them in a single call:
+	 *
+	 *	function onInput(events)
+	 *		for i = 1, #events do
+	 *			local type, key, x, y, window = events:get(i)
+	 *		end
+	 *	end
+	 *
+	 * The events are stored in an array that is allocated once, events that don't fit are dropped. A script reads them through a userdata it creates
+	 * the first time and points at the array every time, so delivering events doesn't allocate. The events can be forwarded to another router as well,
+	 * for example a DefaultInputRouter that passes them on to input components.
+	 */
+	class NAPAPI LuaInputRouter final : public InputRouter
+	{
+	public:
+		/**
+		 * @param capacity maximum number of events per frame
+		 * @param forward router that receives every event as well, nullptr for none
+		 */
+		LuaInputRouter(int capacity = 256, InputRouter* forward = nullptr);
+
+		/**
+		 * Stores the event and forwards it.
+		 */
+		void routeEvent(const InputEvent& event, const EntityList& entities) override;
+
+		/**
+		 * Calls the Lua function 'handler' of the script with the collected events. The events are kept, so more scripts can receive them.
+		 * Only from the thread that owns the script.
+		 * @param script the script
+		 * @param errorState contains the error if calling the function fails
+		 * @param handler name of the Lua function
+		 * @return whether the function was called, true without calling it when there are no events
+		 */
+		bool deliver(LuaScript& script, utility::ErrorState& errorState, const std::string& handler = "onInput");
+
+		/**
+		 * Removes the collected events, call before the events of a new frame are routed.
+		 */
+		void clear() { mEvents.clear(); }
+
+		/**
+		 * @return the collected events
+		 */
+		const std::vector<LuaInputEvent>& getEvents() const { return mEvents; }
+
+		/**
+		 * @return number of events that were dropped because the array was full
+		 */
+		uint64 getDroppedCount() const { return mDropped; }
+
+	private:
+		std::vector<LuaInputEvent> mEvents;
+		size_t mCapacity;
+		InputRouter* mForward;
+		uint64 mDropped = 0;
+	};
+
+
+	/**
+	 * Userdata through which a script reads an array of LuaInputEvents owned by C++, without copying them.
+	 * In Lua, #events is the number of events and events:get(i) returns the type, key, x, y and window of event i (1 based).
+	 */
+	struct NAPAPI LuaInputEventView final
+	{
+		const LuaInputEvent* mEvents = nullptr;
+		int mCount = 0;
+
+		/**
+		 * Creates a view that doesn't point at any events yet and pushes it on the stack of the state.
+		 * @param L the Lua state
+		 * @return the view, which lives as long as Lua keeps a reference to it
+		 */
+		static LuaInputEventView* push(lua_State* L);
+	};
+
+}
@@ -0,0 +1,210 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "LuaMemoryProfiler.h"
+
+#include <utility/stringutils.h>
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <limits>
+
+namespace nap
+{
+
+	// Number of stack levels searched for a Lua function, allocations made deeper in C are attributed to the "C" site.
+	static constexpr int sMaxSiteSearchDepth = 4;
+
+	// Site of a sampled block whose allocation isn't resolved yet.
+	static constexpr uint32 sPendingSite = std::numeric_limits<uint32>::max();
+
+
+	void LuaMemoryProfiler::start(int sampleInterval)
+	{
+		mSampleInterval = std::max(sampleInterval, 1);
+		mUntilSample = mSampleInterval;
+		mRunning = true;
+	}
+
+
+	void LuaMemoryProfiler::stop()
+	{
+		mRunning = false;
+	}
+
+
+	void LuaMemoryProfiler::clear()
+	{
+		mSiteIDs.clear();
+		mSites.clear();
+		mAllocations.clear();
+		mPending.clear();
+	}
+
+
+	bool LuaMemoryProfiler::onAllocation(void* oldBlock, void* newBlock, size_t oldSize, size_t newSize)
+	{
+		// Update or forget the old block when it was sampled.
+		if (oldBlock != nullptr && !mAllocations.empty())
+		{
+			auto it = mAllocations.find(oldBlock);
+			if (it != mAllocations.end())
+			{
+				Allocation allocation = it->second;
+				mAllocations.erase(it);
+
+				// A pending sample follows its block, its live bytes are only counted once it is resolved.
+				if (allocation.mSite == sPendingSite)
+				{
+					for (auto& sample : mPending)
+						if (sample.mBlock == oldBlock)
+							sample.mBlock = newBlock;
+					if (newBlock != nullptr)
+						mAllocations[newBlock] = { allocation.mSite, newSize };
+					return false;
+				}
+
+				SiteStats& site = mSites[allocation.mSite];
+				site.mLiveBytes -= static_cast<int64>(allocation.mSize) * mSampleInterval;
+				if (newBlock == nullptr)
+					return false;
+
+				// A reallocated block stays attributed to the line that allocated it.
+				site.mLiveBytes += static_cast<int64>(newSize) * mSampleInterval;
+				mAllocations[newBlock] = { allocation.mSite, newSize };
+				return false;
+			}
+		}
+
+		// Only new allocations and growing blocks are sampled, frees and shrinks of untracked blocks are ignored.
+		if (!mRunning || newBlock == nullptr || newSize <= oldSize || --mUntilSample > 0)
+			return false;
+		mUntilSample = mSampleInterval;
+
+		// The stack may be halfway a reallocation, the site is looked up later by resolve().
+		mAllocations[newBlock] = { sPendingSite, newSize };
+		mPending.push_back({ newBlock, newSize - oldSize });
+		return mPending.size() == 1;
+	}
+
+
+	void LuaMemoryProfiler::resolve(lua_State* L)
+	{
+		if (mPending.empty())
+			return;
+
+		uint32 id = getSite(L);
+		SiteStats& site = mSites[id];
+		for (const auto& sample : mPending)
+		{
+			site.mAllocations += mSampleInterval;
+			site.mFrameAllocations += mSampleInterval;
+			site.mFrameBytes += sample.mBytes * mSampleInterval;
+			if (sample.mBlock == nullptr)
+				continue;
+
+			auto it = mAllocations.find(sample.mBlock);
+			if (it != mAllocations.end() && it->second.mSite == sPendingSite)
+			{
+				it->second.mSite = id;
+				site.mLiveBytes += static_cast<int64>(it->second.mSize) * mSampleInterval;
+			}
+		}
+		mPending.clear();
+	}
+
+
+	void LuaMemoryProfiler::nextFrame()
+	{
+		resolve(nullptr);
+		for (auto& site : mSites)
+		{
+			site.mLastFrameAllocations = site.mFrameAllocations;
+			site.mLastFrameBytes = site.mFrameBytes;
+			site.mFrameAllocations = 0;
+			site.mFrameBytes = 0;
+		}
+	}
+
+
+	std::vector<LuaMemoryProfiler::Site> LuaMemoryProfiler::getTopSites(int count, bool byFrameAllocations) const
+	{
+		std::vector<Site> sites;
+		sites.reserve(mSites.size());
+		for (const auto& stats : mSites)
+		{
+			Site site;
+			site.mName = stats.mName;
+			site.mLiveBytes = stats.mLiveBytes;
+			site.mAllocations = stats.mAllocations;
+			site.mLastFrameAllocations = stats.mLastFrameAllocations;
+			site.mLastFrameBytes = stats.mLastFrameBytes;
+			sites.emplace_back(std::move(site));
+		}
+
+		auto compare = [byFrameAllocations](const Site& a, const Site& b)
+		{
+			return byFrameAllocations ? a.mLastFrameAllocations > b.mLastFrameAllocations : a.mLiveBytes > b.mLiveBytes;
+		};
+		count = std::min(std::max(count, 0), static_cast<int>(sites.size()));
+		std::partial_sort(sites.begin(), sites.begin() + count, sites.end(), compare);
+		sites.resize(count);
+		return sites;
+	}
+
+
+	bool LuaMemoryProfiler::writeReport(const std::string& path, int count, utility::ErrorState& errorState) const
+	{
+		std::ofstream file(path, std::ios::binary);
+		if (!errorState.check(file.is_open(), "Unable to open file for writing: %s", path.c_str()))
+			return false;
+
+		file << "Live bytes by site (sampled every " << mSampleInterval << " allocations)\n";
+		for (const auto& site : getTopSites(count))
+			file << site.mLiveBytes << "\t" << site.mAllocations << " allocations\t" << site.mName << "\n";
+
+		file << "\nAllocations in the last frame by site\n";
+		for (const auto& site : getTopSites(count, true))
+			file << site.mLastFrameAllocations << "\t" << site.mLastFrameBytes << " bytes\t" << site.mName << "\n";
+
+		return errorState.check(file.good(), "Unable to write memory report to file: %s", path.c_str());
+	}
+
+
+	uint32 LuaMemoryProfiler::getSite(lua_State* L)
+	{
+		// Find the innermost Lua function, allocations are often made by a C function such as a library call.
+		SiteKey key;
+		lua_Debug ar;
+		for (int level = 0; L != nullptr && level < sMaxSiteSearchDepth && lua_getstack(L, level, &ar) != 0; level++)
+		{
+			lua_getinfo(L, "Sl", &ar);
+			if (ar.currentline > 0)
+			{
+				key.mSource = ar.source;
+				key.mLine = ar.currentline;
+				break;
+			}
+		}
+
+		auto it = mSiteIDs.find(key);
+		if (it != mSiteIDs.end())
+			return it->second;
+
+		SiteStats site;
+		site.mName = key.mSource != nullptr ? utility::stringFormat("%s:%d", ar.short_src, key.mLine) : "C";
+		uint32 id = static_cast<uint32>(mSites.size());
+		mSites.emplace_back(std::move(site));
+		mSiteIDs.emplace(key, id);
+		return id;
+	}
+
+
+	size_t LuaMemoryProfiler::SiteKeyHash::operator()(const SiteKey& key) const
+	{
+		return std::hash<const void*>()(key.mSource) ^ (std::hash<int>()(key.mLine) << 1);
+	}
+
+}
@@ -0,0 +1,165 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <utility/dllexport.h>
+#include <utility/errorstate.h>
+#include <nap/numeric.h>
+
+extern "C" {
+	#include <lua.h>
+}
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace nap
+{
+
+	/**
+	 * Attributes the allocations of a single Lua state to the Lua source line that made them.
+	 * Every Nth allocation is sampled and the block is tracked until it is freed.
+	 * The allocator only records the samples, the stack can't be inspected while Lua is allocating.
+	 * The owning LuaScript resolves them from a count hook it arms when the first sample is pending, which fires before the next instruction of the running thread:
+	 * a sample is attributed to the line of the innermost Lua function at that point, which is usually the line that allocated.
+	 * Samples that are not resolved by a hook, such as the allocations made from C++ between calls, are attributed to the "C" site.
+	 * Byte and allocation counts are scaled by the sample interval, so they are estimates unless every allocation is sampled.
+	 */
+	class NAPAPI LuaMemoryProfiler final
+	{
+	public:
+		/**
+		 * Estimated allocation statistics of a single source line.
+		 */
+		struct Site
+		{
+			std::string mName;					///< Source file and line
+			int64 mLiveBytes = 0;				///< Bytes allocated by this line that are not freed yet
+			uint64 mAllocations = 0;			///< Total number of allocations
+			uint64 mLastFrameAllocations = 0;	///< Number of allocations in the previous frame
+			uint64 mLastFrameBytes = 0;			///< Bytes allocated in the previous frame
+		};
+
+		/**
+		 * Starts sampling allocations.
+		 * @param sampleInterval sample every Nth allocation, 1 to sample all of them
+		 */
+		void start(int sampleInterval);
+
+		/**
+		 * Stops sampling new allocations. Blocks that are already tracked are still removed when they are freed.
+		 */
+		void stop();
+
+		/**
+		 * @return whether allocations are sampled
+		 */
+		bool isRunning() const { return mRunning; }
+
+		/**
+		 * @return whether the allocator has to report to the profiler: while it is running or still tracks blocks
+		 */
+		bool isActive() const { return mRunning || !mAllocations.empty(); }
+
+		/**
+		 * @return whether there are samples that are not attributed to a site yet
+		 */
+		bool hasPending() const { return !mPending.empty(); }
+
+		/**
+		 * Discards all statistics and tracked blocks.
+		 */
+		void clear();
+
+		/**
+		 * Called by the allocator of the owning LuaScript for every allocation, reallocation and free.
+		 * Doesn't touch the Lua state: a sampled allocation is recorded as pending until resolve() is called.
+		 * @param oldBlock the block that is reallocated or freed, nullptr for a new allocation
+		 * @param newBlock the resulting block, nullptr when freed
+		 * @param oldSize size of the old block
+		 * @param newSize size of the new block
+		 * @return whether the allocation is the first pending sample, resolve() has to be called before the next instruction to attribute it
+		 */
+		bool onAllocation(void* oldBlock, void* newBlock, size_t oldSize, size_t newSize);
+
+		/**
+		 * Attributes the pending samples to the line the given thread is running.
+		 * Called from the debug hook of the owning LuaScript, where the stack of the running thread is consistent.
+		 * @param L the running thread, nullptr to attribute the samples to the "C" site
+		 */
+		void resolve(lua_State* L);
+
+		/**
+		 * Stores the allocations of the frame that ended as the last frame counts.
+		 * Pending samples are attributed to the "C" site first.
+		 */
+		void nextFrame();
+
+		/**
+		 * @param count maximum number of sites
+		 * @param byFrameAllocations sort on the allocations of the last frame instead of on live bytes
+		 * @return the sites with the most live bytes, or the most allocations in the last frame
+		 */
+		std::vector<Site> getTopSites(int count, bool byFrameAllocations = false) const;
+
+		/**
+		 * Writes a report of the top sites, by live bytes and by allocations in the last frame.
+		 * @param path the file to write to
+		 * @param count number of sites per table
+		 * @param errorState contains the error if the file can't be written
+		 * @return whether the file was written
+		 */
+		bool writeReport(const std::string& path, int count, utility::ErrorState& errorState) const;
+
+	private:
+		struct SiteKey
+		{
+			const void* mSource = nullptr;
+			int mLine = 0;
+			bool operator==(const SiteKey& other) const { return mSource == other.mSource && mLine == other.mLine; }
+		};
+
+		struct SiteKeyHash
+		{
+			size_t operator()(const SiteKey& key) const;
+		};
+
+		struct SiteStats
+		{
+			std::string mName;
+			int64 mLiveBytes = 0;
+			uint64 mAllocations = 0;
+			uint64 mFrameAllocations = 0;
+			uint64 mFrameBytes = 0;
+			uint64 mLastFrameAllocations = 0;
+			uint64 mLastFrameBytes = 0;
+		};
+
+		struct Allocation
+		{
+			uint32 mSite = 0;
+			size_t mSize = 0;
+		};
+
+		struct PendingSample
+		{
+			void* mBlock = nullptr;		///< The sampled block, nullptr once it is freed
+			size_t mBytes = 0;			///< Bytes added by the allocation
+		};
+
+		uint32 getSite(lua_State* L);
+
+		bool mRunning = false;
+		int mSampleInterval = 1;
+		int mUntilSample = 1;
+
+		std::unordered_map<SiteKey, uint32, SiteKeyHash> mSiteIDs;	///< Interned source lines
+		std::vector<SiteStats> mSites;								///< Statistics per site id
+		std::unordered_map<void*, Allocation> mAllocations;			///< Sampled blocks that are not freed yet
+		std::vector<PendingSample> mPending;						///< Samples that are not attributed to a site yet
+	};
+
+}
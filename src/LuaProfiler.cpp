@@ -0,0 +1,146 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "LuaProfiler.h"
+
+#include <utility/stringutils.h>
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+
+namespace nap
+{
+
+	// Deeper stacks are truncated, keeping the innermost frames.
+	static constexpr int sMaxStackDepth = 64;
+
+
+	void LuaProfiler::start(int sampleInterval)
+	{
+		mSampleInterval = std::max(sampleInterval, 1);
+		mRunning = true;
+	}
+
+
+	void LuaProfiler::stop()
+	{
+		mRunning = false;
+	}
+
+
+	void LuaProfiler::clear()
+	{
+		mSampleCount = 0;
+		mProfiledTime = 0.0;
+		mFrameIDs.clear();
+		mFrameNames.clear();
+		mStackCounts.clear();
+	}
+
+
+	void LuaProfiler::sample(lua_State* L)
+	{
+		// Collect the frame ids from the innermost to the outermost function.
+		mScratchStack.clear();
+		lua_Debug ar;
+		for (int level = 0; level < sMaxStackDepth && lua_getstack(L, level, &ar) != 0; level++)
+			mScratchStack.emplace_back(getFrameID(L, ar));
+
+		// Only a stack that wasn't seen before is copied into the table.
+		auto it = mStackCounts.find(mScratchStack);
+		if (it == mStackCounts.end())
+			it = mStackCounts.emplace(mScratchStack, 0).first;
+		it->second++;
+		mSampleCount++;
+	}
+
+
+	uint32 LuaProfiler::getFrameID(lua_State* L, lua_Debug& ar)
+	{
+		lua_getinfo(L, "S", &ar);
+
+		// Lua functions are identified by their definition, C functions by their address.
+		FrameKey key;
+		bool is_c_function = ar.what[0] == 'C';
+		if (is_c_function)
+		{
+			lua_getinfo(L, "f", &ar);
+			key.mFunction = reinterpret_cast<const void*>(lua_tocfunction(L, -1));
+			lua_pop(L, 1);
+			key.mLine = -1;
+		}
+		else
+		{
+			key.mFunction = ar.source;
+			key.mLine = ar.linedefined;
+		}
+
+		auto it = mFrameIDs.find(key);
+		if (it != mFrameIDs.end())
+			return it->second;
+
+		// Name the frame the first time it is seen.
+		lua_getinfo(L, "n", &ar);
+		std::string name = ar.name != nullptr ? ar.name : (ar.what[0] == 'm' ? "main chunk" : "?");
+		if (!is_c_function)
+			name += utility::stringFormat(" (%s:%d)", ar.short_src, ar.linedefined);
+		std::replace(name.begin(), name.end(), ';', ':');
+
+		uint32 id = static_cast<uint32>(mFrameNames.size());
+		mFrameNames.emplace_back(std::move(name));
+		mFrameIDs.emplace(key, id);
+		return id;
+	}
+
+
+	std::string LuaProfiler::getCollapsedStacks() const
+	{
+		std::string result;
+		for (const auto& [stack, count] : mStackCounts)
+		{
+			for (auto it = stack.rbegin(); it != stack.rend(); ++it)
+			{
+				if (it != stack.rbegin())
+					result += ';';
+				result += mFrameNames[*it];
+			}
+			result += ' ';
+			result += std::to_string(count);
+			result += '\n';
+		}
+		return result;
+	}
+
+
+	bool LuaProfiler::writeCollapsedStacks(const std::string& path, utility::ErrorState& errorState) const
+	{
+		std::ofstream file(path, std::ios::binary);
+		if (!errorState.check(file.is_open(), "Unable to open file for writing: %s", path.c_str()))
+			return false;
+
+		file << getCollapsedStacks();
+		return errorState.check(file.good(), "Unable to write profile to file: %s", path.c_str());
+	}
+
+
+	size_t LuaProfiler::FrameKeyHash::operator()(const FrameKey& key) const
+	{
+		return std::hash<const void*>()(key.mFunction) ^ (std::hash<int>()(key.mLine) << 1);
+	}
+
+
+	size_t LuaProfiler::StackHash::operator()(const std::vector<uint32>& stack) const
+	{
+		// FNV-1a over the frame ids.
+		size_t hash = 14695981039346656037ull;
+		for (uint32 id : stack)
+		{
+			hash ^= id;
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+}
@@ -0,0 +1,123 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <utility/dllexport.h>
+#include <utility/errorstate.h>
+#include <nap/numeric.h>
+
+extern "C" {
+	#include <lua.h>
+}
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace nap
+{
+
+	/**
+	 * Sampling profiler for a single Lua state.
+	 * The owning LuaScript installs a count hook while the profiler is running, every time the hook fires the current call stack is sampled.
+	 * Stacks are stored as arrays of interned frame ids, so taking a sample of a known stack doesn't allocate.
+	 * The aggregated stacks can be written in the collapsed stack format that flamegraph.pl, speedscope and inferno read.
+	 */
+	class NAPAPI LuaProfiler final
+	{
+	public:
+		/**
+		 * Starts sampling. The owning LuaScript is responsible for installing the hook.
+		 * @param sampleInterval number of Lua VM instructions between samples
+		 */
+		void start(int sampleInterval);
+
+		/**
+		 * Stops sampling, the collected samples are kept.
+		 */
+		void stop();
+
+		/**
+		 * @return whether the profiler is sampling
+		 */
+		bool isRunning() const { return mRunning; }
+
+		/**
+		 * @return number of Lua VM instructions between samples
+		 */
+		int getSampleInterval() const { return mSampleInterval; }
+
+		/**
+		 * Discards all collected samples and time.
+		 */
+		void clear();
+
+		/**
+		 * Samples the call stack of the given state. Called from the count hook.
+		 * @param L the state, or coroutine, that is currently executing
+		 */
+		void sample(lua_State* L);
+
+		/**
+		 * Adds time spent inside Lua while the profiler was running. Called by the owning LuaScript at the call boundary.
+		 * @param seconds duration of the call
+		 */
+		void addTime(double seconds) { mProfiledTime += seconds; }
+
+		/**
+		 * @return total number of samples taken
+		 */
+		uint64 getSampleCount() const { return mSampleCount; }
+
+		/**
+		 * @return total time in seconds spent inside Lua while the profiler was running
+		 */
+		double getProfiledTime() const { return mProfiledTime; }
+
+		/**
+		 * @return the aggregated stacks in collapsed stack format: one line per unique stack, frames from outer to inner separated by ';', followed by the sample count
+		 */
+		std::string getCollapsedStacks() const;
+
+		/**
+		 * Writes the aggregated stacks in collapsed stack format to a file.
+		 * @param path the file to write to
+		 * @param errorState contains the error if the file can't be written
+		 * @return whether the file was written
+		 */
+		bool writeCollapsedStacks(const std::string& path, utility::ErrorState& errorState) const;
+
+	private:
+		struct FrameKey
+		{
+			const void* mFunction = nullptr;	///< Source string for Lua functions, function pointer for C functions.
+			int mLine = 0;						///< Line on which a Lua function is defined.
+			bool operator==(const FrameKey& other) const { return mFunction == other.mFunction && mLine == other.mLine; }
+		};
+
+		struct FrameKeyHash
+		{
+			size_t operator()(const FrameKey& key) const;
+		};
+
+		struct StackHash
+		{
+			size_t operator()(const std::vector<uint32>& stack) const;
+		};
+
+		uint32 getFrameID(lua_State* L, lua_Debug& ar);
+
+		bool mRunning = false;
+		int mSampleInterval = 1000;
+		uint64 mSampleCount = 0;
+		double mProfiledTime = 0.0;
+
+		std::unordered_map<FrameKey, uint32, FrameKeyHash> mFrameIDs;				///< Interned frames.
+		std::vector<std::string> mFrameNames;										///< Display name per frame id.
+		std::unordered_map<std::vector<uint32>, uint64, StackHash> mStackCounts;	///< Sample count per stack, frames ordered from inner to outer.
+		std::vector<uint32> mScratchStack;											///< Reused while sampling to look up stacks without allocating.
+	};
+
+}
@@ -0,0 +1,307 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "LuaScheduler.h"
+#include "LuaFuture.h"
+
+#include <nap/logger.h>
+
+#include <algorithm>
+
+namespace nap
+{
+
+	namespace
+	{
+		// Orders the queues as min-heaps: earliest due first, then the task that started waiting first.
+		template <typename T>
+		bool isLater(const T& a, const T& b)
+		{
+			return a.mDue > b.mDue || (a.mDue == b.mDue && a.mSequence > b.mSequence);
+		}
+	}
+
+
+	void LuaScheduler::init(lua_State* L, const std::string& name)
+	{
+		this->L = L;
+		mName = name;
+
+		// The scheduler is an upvalue of its functions, in the real globals so they stay visible in a fresh environment.
+		const std::pair<const char*, lua_CFunction> functions[] =
+		{
+			{ "spawn", &LuaScheduler::spawn },
+			{ "wait", &LuaScheduler::wait },
+			{ "waitFrames", &LuaScheduler::waitFrames },
+			{ "waitSignal", &LuaScheduler::waitSignal },
+			{ "emitSignal", &LuaScheduler::emitSignal },
+			{ "await", &LuaScheduler::await }
+		};
+		for (const auto& [function_name, function] : functions)
+		{
+			lua_pushlightuserdata(L, this);
+			lua_pushcclosure(L, function, 1);
+			lua_setglobal(L, function_name);
+		}
+
+		// Bound functions return futures as shared pointers.
+		luabridge::getGlobalNamespace(L)
+			.beginClass<LuaFuture>("LuaFuture")
+				.addFunction("isReady", &LuaFuture::isReady)
+			.endClass();
+	}
+
+
+	void LuaScheduler::clear()
+	{
+		for (const auto& queued : mTimeQueue)
+			release(queued.mTask);
+		for (const auto& queued : mFrameQueue)
+			release(queued.mTask);
+		for (const auto& [name, tasks] : mSignalWaits)
+			for (const auto& task : tasks)
+				release(task);
+		for (const auto& task : mReady)
+			release(task);
+		for (const auto& awaiting : mAwaits)
+			release(awaiting.mTask);
+
+		mTimeQueue.clear();
+		mFrameQueue.clear();
+		mSignalWaits.clear();
+		mReady.clear();
+		mAwaits.clear();
+		mThreads.clear();
+		mTaskCount = 0;
+	}
+
+
+	void LuaScheduler::start(lua_State* from, int argumentCount)
+	{
+		// The registry keeps the coroutine alive while it waits.
+		Task task;
+		task.mThread = lua_newthread(from);
+		task.mRef = luaL_ref(from, LUA_REGISTRYINDEX);
+		mThreads.insert(task.mThread);
+		lua_xmove(from, task.mThread, argumentCount + 1);
+		mTaskCount++;
+		resume(from, task, argumentCount);
+	}
+
+
+	void LuaScheduler::update(double deltaTime)
+	{
+		mTime += deltaTime;
+		mFrame++;
+
+		// Collect all due tasks before continuing them, a task that waits again is continued at the next update at the earliest.
+		mDue.swap(mReady);
+		popDue(mTimeQueue, mTime);
+		popDue(mFrameQueue, static_cast<double>(mFrame));
+		for (size_t i = 0; i < mAwaits.size();)
+		{
+			if (mAwaits[i].mFuture->isReady())
+			{
+				mDueAwaits.emplace_back(std::move(mAwaits[i]));
+				mAwaits[i] = std::move(mAwaits.back());
+				mAwaits.pop_back();
+			}
+			else
+			{
+				i++;
+			}
+		}
+
+		for (const auto& task : mDue)
+			resume(L, task, 0);
+		mDue.clear();
+
+		// The results are pushed on the stack of the task, they are returned by await().
+		for (const auto& awaiting : mDueAwaits)
+			resume(L, awaiting.mTask, awaiting.mFuture->pushResults(awaiting.mTask.mThread));
+		mDueAwaits.clear();
+	}
+
+
+	void LuaScheduler::emitSignal(const std::string& name)
+	{
+		auto it = mSignalWaits.find(name);
+		if (it == mSignalWaits.end())
+			return;
+
+		mReady.insert(mReady.end(), it->second.begin(), it->second.end());
+		it->second.clear();
+	}
+
+
+	void LuaScheduler::resume(lua_State* from, const Task& task, int argumentCount)
+	{
+		// A task can start another one, which runs nested in it until it waits.
+		Task previous = mCurrent;
+		WaitRequest previous_request = std::move(mRequest);
+		mCurrent = task;
+		mRequest = WaitRequest();
+
+		int result_count = 0;
+		int status = luacompat::resume(task.mThread, from, argumentCount, result_count);
+		if (status == LUA_YIELD)
+		{
+			// The wait functions yield the scheduler. A request of a wait function that couldn't yield is ignored, a plain yield waits for the next update.
+			bool requested = result_count == 1 && lua_islightuserdata(task.mThread, -1) && lua_touserdata(task.mThread, -1) == this;
+			lua_pop(task.mThread, result_count);
+			if (!requested)
+				mRequest = WaitRequest();
+			schedule(task, mRequest);
+		}
+		else
+		{
+			if (status != LUA_OK)
+				Logger::warn("%s: error in task: %s", mName.c_str(), lua_isstring(task.mThread, -1) ? lua_tostring(task.mThread, -1) : "unknown error");
+			release(task);
+			mTaskCount--;
+		}
+
+		mCurrent = previous;
+		mRequest = std::move(previous_request);
+	}
+
+
+	void LuaScheduler::schedule(const Task& task, const WaitRequest& request)
+	{
+		switch (request.mType)
+		{
+		case EWait::Frame:
+			schedule(mFrameQueue, task, request.mDue > 0.0 ? request.mDue : static_cast<double>(mFrame + 1));
+			break;
+		case EWait::Time:
+			schedule(mTimeQueue, task, request.mDue);
+			break;
+		case EWait::Signal:
+			mSignalWaits[request.mSignal].emplace_back(task);
+			break;
+		case EWait::Future:
+			mAwaits.push_back({ request.mFuture, task });
+			break;
+		}
+	}
+
+
+	void LuaScheduler::schedule(std::vector<QueuedTask>& queue, const Task& task, double due)
+	{
+		QueuedTask queued;
+		queued.mDue = due;
+		queued.mSequence = mSequence++;
+		queued.mTask = task;
+		queue.emplace_back(queued);
+		std::push_heap(queue.begin(), queue.end(), &isLater<QueuedTask>);
+	}
+
+
+	void LuaScheduler::popDue(std::vector<QueuedTask>& queue, double now)
+	{
+		while (!queue.empty() && queue.front().mDue <= now)
+		{
+			mDue.emplace_back(queue.front().mTask);
+			std::pop_heap(queue.begin(), queue.end(), &isLater<QueuedTask>);
+			queue.pop_back();
+		}
+	}
+
+
+	void LuaScheduler::release(const Task& task)
+	{
+		mThreads.erase(task.mThread);
+		luaL_unref(L, LUA_REGISTRYINDEX, task.mRef);
+	}
+
+
+	LuaScheduler* LuaScheduler::getScheduler(lua_State* L)
+	{
+		return static_cast<LuaScheduler*>(lua_touserdata(L, lua_upvalueindex(1)));
+	}
+
+
+	void LuaScheduler::checkTask(lua_State* L, const char* function)
+	{
+		if (getScheduler(L)->mCurrent.mThread != L)
+			luaL_error(L, "%s can only be called from a task started with spawn", function);
+		if (!luacompat::isYieldable(L))
+			luaL_error(L, "%s can't suspend the task across a C call boundary", function);
+	}
+
+
+	int LuaScheduler::yield(lua_State* L)
+	{
+		// Nothing is queued yet: resume() queues the task with the recorded request when it sees this value, so a failed yield leaves no trace.
+		lua_pushlightuserdata(L, getScheduler(L));
+		return lua_yield(L, 1);
+	}
+
+
+	int LuaScheduler::spawn(lua_State* L)
+	{
+		luaL_checktype(L, 1, LUA_TFUNCTION);
+		getScheduler(L)->start(L, lua_gettop(L) - 1);
+		return 0;
+	}
+
+
+	int LuaScheduler::wait(lua_State* L)
+	{
+		double seconds = luaL_checknumber(L, 1);
+		checkTask(L, "wait");
+		LuaScheduler* scheduler = getScheduler(L);
+		scheduler->mRequest.mType = EWait::Time;
+		scheduler->mRequest.mDue = scheduler->mTime + std::max(seconds, 0.0);
+		return yield(L);
+	}
+
+
+	int LuaScheduler::waitFrames(lua_State* L)
+	{
+		auto frames = static_cast<int>(luaL_checknumber(L, 1));
+		checkTask(L, "waitFrames");
+		LuaScheduler* scheduler = getScheduler(L);
+		scheduler->mRequest.mType = EWait::Frame;
+		scheduler->mRequest.mDue = static_cast<double>(scheduler->mFrame + std::max(frames, 1));
+		return yield(L);
+	}
+
+
+	int LuaScheduler::waitSignal(lua_State* L)
+	{
+		const char* name = luaL_checkstring(L, 1);
+		checkTask(L, "waitSignal");
+		LuaScheduler* scheduler = getScheduler(L);
+		scheduler->mRequest.mType = EWait::Signal;
+		scheduler->mRequest.mSignal = name;
+		return yield(L);
+	}
+
+
+	int LuaScheduler::emitSignal(lua_State* L)
+	{
+		getScheduler(L)->emitSignal(luaL_checkstring(L, 1));
+		return 0;
+	}
+
+
+	int LuaScheduler::await(lua_State* L)
+	{
+		if (!luabridge::isInstance<LuaFuture*>(L, 1))
+			return luaL_error(L, "await expects a future");
+		checkTask(L, "await");
+
+		// A future that is done already doesn't suspend the task.
+		LuaFuture* future = luabridge::get<LuaFuture*>(L, 1).value();
+		if (future->isReady())
+			return future->pushResults(L);
+
+		LuaScheduler* scheduler = getScheduler(L);
+		scheduler->mRequest.mType = EWait::Future;
+		scheduler->mRequest.mFuture = future->shared_from_this();
+		return yield(L);
+	}
+
+}
@@ -0,0 +1,170 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include "LuaCompat.h"
+
+#include <utility/dllexport.h>
+#include <nap/numeric.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace nap
+{
+
+	class LuaFuture;
+
+	/**
+	 * Runs Lua coroutines as tasks that span frames, for scripted sequences.
+	 * Adds these globals to the state:
+	 * - spawn(func, ...): starts a task that calls func with the arguments, it runs until it waits for the first time.
+	 * - wait(seconds): suspends the task for the given time.
+	 * - waitFrames(n): suspends the task for n updates.
+	 * - waitSignal(name): suspends the task until the signal is emitted, it continues at the next update.
+	 * - emitSignal(name): continues the tasks that wait for the signal.
+	 * - await(future): suspends the task until the C++ work of the LuaFuture is done and returns its results, or nil and the error.
+	 * A task that yields with coroutine.yield() continues at the next update.
+	 * Waiting tasks are kept in queues ordered by the time and the frame they are due, an update only looks at the tasks that are due and at the awaited futures.
+	 */
+	class NAPAPI LuaScheduler final
+	{
+	public:
+		/**
+		 * Adds the task functions and the LuaFuture class to the globals of the state.
+		 * @param L the Lua state
+		 * @param name name used in error messages
+		 */
+		void init(lua_State* L, const std::string& name);
+
+		/**
+		 * Stops all tasks.
+		 */
+		void clear();
+
+		/**
+		 * Starts a task: pops a function and its arguments from the stack of 'from' and runs it until it waits.
+		 * @param from the state or coroutine with the function and the arguments on top of its stack
+		 * @param argumentCount number of arguments above the function
+		 */
+		void start(lua_State* from, int argumentCount);
+
+		/**
+		 * Advances the time and the frame count, and continues the tasks that are due. Errors of tasks are logged.
+		 * @param deltaTime time since the previous update in seconds
+		 */
+		void update(double deltaTime);
+
+		/**
+		 * Continues the tasks that wait for the signal at the next update.
+		 * @param name name of the signal
+		 */
+		void emitSignal(const std::string& name);
+
+		/**
+		 * @return number of tasks that didn't finish yet
+		 */
+		int getTaskCount() const { return mTaskCount; }
+
+		/**
+		 * @return the coroutines of the tasks that didn't finish yet. They copied the debug hook of the thread that started them,
+		 * so changes to the hook have to be applied to them as well.
+		 */
+		const std::unordered_set<lua_State*>& getThreads() const { return mThreads; }
+
+		/**
+		 * @return the coroutine of the task that is running, nullptr when no task is resumed
+		 */
+		lua_State* getCurrentThread() const { return mCurrent.mThread; }
+
+		/**
+		 * @return time in seconds advanced by update()
+		 */
+		double getTime() const { return mTime; }
+
+		/**
+		 * @return number of updates
+		 */
+		uint64 getFrame() const { return mFrame; }
+
+	private:
+		struct Task
+		{
+			lua_State* mThread = nullptr;	///< The coroutine
+			int mRef = LUA_NOREF;			///< Registry reference that keeps the coroutine alive
+		};
+
+		struct QueuedTask
+		{
+			double mDue = 0.0;				///< Time or frame at which the task continues
+			uint64 mSequence = 0;			///< Keeps tasks that are due at the same moment in the order they started waiting
+			Task mTask;
+		};
+
+		struct AwaitingTask
+		{
+			std::shared_ptr<LuaFuture> mFuture;
+			Task mTask;
+		};
+
+		enum class EWait
+		{
+			Frame,		///< Waits for a frame
+			Time,		///< Waits for a time
+			Signal,		///< Waits for a signal
+			Future		///< Waits for a future
+		};
+
+		/**
+		 * What the running task waits for, recorded by the wait functions and queued by resume() once the task yielded.
+		 */
+		struct WaitRequest
+		{
+			EWait mType = EWait::Frame;
+			double mDue = 0.0;						///< Time or frame at which the task continues
+			std::string mSignal;					///< The signal the task waits for
+			std::shared_ptr<LuaFuture> mFuture;		///< The future the task waits for
+		};
+
+		void resume(lua_State* from, const Task& task, int argumentCount);
+		void schedule(const Task& task, const WaitRequest& request);
+		void schedule(std::vector<QueuedTask>& queue, const Task& task, double due);
+		void popDue(std::vector<QueuedTask>& queue, double now);
+		void release(const Task& task);
+
+		static LuaScheduler* getScheduler(lua_State* L);
+		static void checkTask(lua_State* L, const char* function);
+		static int yield(lua_State* L);
+		static int spawn(lua_State* L);
+		static int wait(lua_State* L);
+		static int waitFrames(lua_State* L);
+		static int waitSignal(lua_State* L);
+		static int emitSignal(lua_State* L);
+		static int await(lua_State* L);
+
+		lua_State* L = nullptr;
+		std::string mName;
+		double mTime = 0.0;
+		uint64 mFrame = 0;
+		uint64 mSequence = 0;
+		int mTaskCount = 0;
+
+		std::vector<QueuedTask> mTimeQueue;		///< Heap of tasks waiting for a time
+		std::vector<QueuedTask> mFrameQueue;	///< Heap of tasks waiting for a frame
+		std::unordered_map<std::string, std::vector<Task>> mSignalWaits;	///< Tasks waiting for a signal, by name
+		std::vector<Task> mReady;				///< Tasks whose signal was emitted, continued at the next update
+		std::vector<Task> mDue;					///< Tasks continued by the running update
+		std::vector<AwaitingTask> mAwaits;		///< Tasks waiting for a future
+		std::vector<AwaitingTask> mDueAwaits;	///< Tasks whose future is done, continued by the running update
+		std::unordered_set<lua_State*> mThreads;	///< Coroutines of the tasks that didn't finish yet
+
+		Task mCurrent;							///< The running task
+		WaitRequest mRequest;					///< What the running task waits for when it yields from a wait function
+	};
+
+}
@@ -4,55 +4,1386 @@
 // Written by Casimir Geelhoed in 2024.
 
 #include "LuaScript.h"
+#include "LuaInputRouter.h"
+#include "LuaService.h"
+#include "MappedFile.h"
 
-#include <utility/fileutils.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
 
 #include <glm/glm.hpp>
 
+RTTI_BEGIN_ENUM(nap::ELuaGCMode)
+	RTTI_ENUM_VALUE(nap::ELuaGCMode::Incremental, "Incremental"),
+	RTTI_ENUM_VALUE(nap::ELuaGCMode::Generational, "Generational")
+RTTI_END_ENUM
+
+RTTI_BEGIN_ENUM(nap::ELuaInitMode)
+	RTTI_ENUM_VALUE(nap::ELuaInitMode::Serial, "Serial"),
+	RTTI_ENUM_VALUE(nap::ELuaInitMode::Parallel, "Parallel"),
+	RTTI_ENUM_VALUE(nap::ELuaInitMode::Background, "Background")
+RTTI_END_ENUM
+
 RTTI_BEGIN_CLASS(nap::LuaScript)
 	RTTI_PROPERTY_FILELINK("Path", &nap::LuaScript::mPath, nap::rtti::EPropertyMetaData::Required, nap::rtti::EPropertyFileType::Any)
+	RTTI_PROPERTY("TraceCapacity", &nap::LuaScript::mTraceCapacity, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("FreshEnvironment", &nap::LuaScript::mFreshEnvironment, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("InstructionBudget", &nap::LuaScript::mInstructionBudget, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("TimeBudget", &nap::LuaScript::mTimeBudget, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("Quarantine", &nap::LuaScript::mQuarantine, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("GCMode", &nap::LuaScript::mGCMode, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("GCPause", &nap::LuaScript::mGCPause, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("GCStepMultiplier", &nap::LuaScript::mGCStepMultiplier, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("GCMinorMultiplier", &nap::LuaScript::mGCMinorMultiplier, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("GCMajorMultiplier", &nap::LuaScript::mGCMajorMultiplier, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("Asynchronous", &nap::LuaScript::mAsynchronous, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("UpdateFunction", &nap::LuaScript::mUpdateFunction, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("CallQueueCapacity", &nap::LuaScript::mCallQueueCapacity, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("RealTime", &nap::LuaScript::mRealTime, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("ArenaSize", &nap::LuaScript::mArenaSize, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("ProcessFunction", &nap::LuaScript::mProcessFunction, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("MaxChannels", &nap::LuaScript::mMaxChannels, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("InitMode", &nap::LuaScript::mInitMode, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("EventDriven", &nap::LuaScript::mEventDriven, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("Inputs", &nap::LuaScript::mInputNames, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("Outputs", &nap::LuaScript::mOutputNames, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("Signals", &nap::LuaScript::mSignalNames, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("Channels", &nap::LuaScript::mChannels, nap::rtti::EPropertyMetaData::Default)
 RTTI_END_CLASS
 
 namespace nap
 {
 
+	namespace
+	{
+		// Registry key under which the owning script is stored, so hooks can find it.
+		int sScriptKey = 0;
+		
+		// Name under which running the script chunk shows up in the call statistics.
+		const std::string sLoadIdentifier = "(load)";
+		
+		// Name under which an update of the tasks shows up in the call statistics.
+		const std::string sTasksIdentifier = "(tasks)";
+		
+		// Number of instructions between budget checks.
+		constexpr int sBudgetCheckInterval = 1000;
+		
+		// The script whose asynchronous update runs on this thread, it may call back into the script without waiting.
+		thread_local LuaScript* sUpdatingScript = nullptr;
+		
+		
+		/**
+		 * Hands a script or precompiled chunk in memory to the Lua parser without copying it.
+		 */
+		struct ChunkReader
+		{
+			const char* mData = nullptr;
+			size_t mSize = 0;
+			bool mDone = false;
+		};
+		
+		
+		const char* readChunk(lua_State* L, void* data, size_t* size)
+		{
+			auto* reader = static_cast<ChunkReader*>(data);
+			if (reader->mDone || reader->mSize == 0)
+			{
+				*size = 0;
+				return nullptr;
+			}
+			
+			// The whole chunk is one contiguous block, for a mapping the parser pulls pages in as it goes.
+			reader->mDone = true;
+			*size = reader->mSize;
+			return reader->mData;
+		}
+		
+		
+		int writeChunk(lua_State* L, const void* data, size_t size, void* userData)
+		{
+			auto* bytecode = static_cast<std::vector<char>*>(userData);
+			bytecode->insert(bytecode->end(), static_cast<const char*>(data), static_cast<const char*>(data) + size);
+			return 0;
+		}
+	}
+
+
 	bool LuaScript::init(utility::ErrorState& errorState)
 	{
-		// Read file to string.
-		if (!utility::readFileToString(mPath, mScriptAsString, errorState))
+		// Map the script file, it is unmapped again once the script is compiled.
+		// The stamp is read first, a save while the file is mapped shows up as a change on the next load.
+		auto file = std::make_shared<MappedFile>();
+		LuaFileStamp::get(mPath, mSourceStamp);
+		if (!file->open(mPath, errorState))
 			return false;
 		
+		if (mCallQueueCapacity > 0)
+			mCallQueue.init(mCallQueueCapacity);
+		mSourceVersion = LuaSourceVersion::get(file->getData(), file->getSize());
+		
+		// A real-time state allocates from its arena from the start.
+		if (mRealTime)
+		{
+			if (!errorState.check(luacompat::failsAllocationsWithoutCollecting(), "%s: real-time scripts are not supported with %s, it collects garbage on the audio thread when the arena is full", mPath.c_str(), luacompat::getVersion()) ||
+				!errorState.check(!hasUpdate(), "%s: a real-time script can't be asynchronous or event-driven", mPath.c_str()) ||
+				!errorState.check(mChannels.empty(), "%s: a real-time script can't use channels", mPath.c_str()) ||
+				!errorState.check(mArenaSize > 0 && mMaxChannels >= 0, "%s: invalid arena size or maximum number of channels", mPath.c_str()) ||
+				!mArena.init(static_cast<size_t>(mArenaSize), errorState))
+				return false;
+			mQueuedFunction.reserve(LuaCallQueue::sMaxNameLength);
+		}
+		
+		if (mService == nullptr && mAsynchronous)
+			Logger::warn("%s: not created by the LuaService, the asynchronous update runs on the thread that starts it", mPath.c_str());
+		
+		// Counted before the state is created, so the scripts of the same file that initialise in parallel share their chunk.
+		if (mService != nullptr)
+		{
+			mService->getBytecodeCache().addUser(mPath);
+			mBytecodeUser = true;
+		}
+		
+		if (mInitMode == ELuaInitMode::Serial || mService == nullptr || mRealTime)
+		{
+			if (!createState(*file, true, errorState))
+			{
+				releaseBytecode();
+				return false;
+			}
+			
+			// If the script was not loaded succesfully, we still return true, allowing the user to fix the script at runtime.
+			if (!mInitError.empty())
+				Logger::info(mInitError);
+			mInitError.clear();
+			if (mService != nullptr)
+				mService->registerScript(*this);
+			return true;
+		}
+		
+		// Read, create and compile on a worker thread, like an asynchronous update: every function that uses the state waits for it first.
+		bool run = mInitMode == ELuaInitMode::Background;
+		mInitPending = true;
+		mUpdate = mService->getThreadPool().submit([this, file, run]()
+		{
+			sUpdatingScript = this;
+			utility::ErrorState error_state;
+			if (!createState(*file, run, error_state))
+				mInitError = error_state.toString();
+			sUpdatingScript = nullptr;
+		});
+		mService->registerScript(*this);
+		return true;
+	}
+	
+	
+	bool LuaScript::createState(const MappedFile& file, bool run, utility::ErrorState& errorState)
+	{
 		// Create Lua state.
-		L = luaL_newstate();
+		L = luacompat::newState(&LuaScript::allocate, this);
+		if (!errorState.check(L != nullptr, "Unable to create Lua state"))
+			return false;
+		
+		if (lua_getallocf(L, nullptr) != &LuaScript::allocate)
+		{
+			if (!errorState.check(!mRealTime, "%s: the Lua implementation doesn't support custom allocators, required by real-time scripts", mPath.c_str()))
+				return false;
+			Logger::warn("%s: the Lua implementation doesn't support custom allocators, allocations are not tracked", mPath.c_str());
+		}
 		
 		// Add libraries.
 		luaL_openlibs(L);
+		updateGarbageCollector();
 		
 		// Enable exceptions.
 		luabridge::LuaException::enableExceptions(L);
 		
-		// Load the script.
-		if(!load(errorState))
-			Logger::info(errorState.toString());
+		// Store the owner of the state, for the debug hooks.
+		lua_pushlightuserdata(L, this);
+		luacompat::rawSetPointer(L, LUA_REGISTRYINDEX, &sScriptKey);
+		mScheduler.init(L, mPath);
+		
+		// The tables the asynchronous update reads its inputs from and writes its outputs to, kept for the lifetime of the state.
+		lua_newtable(L);
+		mInputsRef = luaL_ref(L, LUA_REGISTRYINDEX);
+		lua_newtable(L);
+		mOutputsRef = luaL_ref(L, LUA_REGISTRYINDEX);
+		
+		// Called functions with the index of their call statistics. Weak, so a collected function is never taken for a new one at the same address,
+		// and sized up front, so the first calls of a real-time script don't allocate.
+		lua_createtable(L, 0, LuaCallStats::sMaxFunctions);
+		lua_createtable(L, 0, 1);
+		lua_pushstring(L, "k");
+		lua_setfield(L, -2, "__mode");
+		lua_setmetatable(L, -2);
+		mCallStatsIndicesRef = luaL_ref(L, LUA_REGISTRYINDEX);
+		if (mRealTime)
+			createBufferViews();
+		
+		// The channels of the script, by ID.
+		lua_newtable(L);
+		for (auto& channel : mChannels)
+			channel->addTo(L);
+		lua_setglobal(L, "channels");
+		
+		// Trace from the start when requested, otherwise only install the hook of the active tools.
+		if (mTraceCapacity > 0)
+			startTracing(mTraceCapacity);
+		else
+			updateHook();
 		
-		// If the script was not loaded succesfully, we still return true, allowing the user to fix the script at runtime.
+		// Compile and load the script, its errors are logged by the thread that finishes the initialisation.
+		utility::ErrorState script_error;
+		// The file was just read, running the chunk doesn't check it for changes again.
+		if (!compile(file, mSourceVersion, script_error) || (run && !runChunk(script_error)))
+			mInitError = script_error.toString();
+		
+		// Collect what loading left behind, from now on only collectGarbage() collects.
+		if (mRealTime)
+		{
+			lua_gc(L, LUA_GCCOLLECT, 0);
+			lua_gc(L, LUA_GCSTOP, 0);
+		}
+		return true;
+	}
+	
+	
+	void LuaScript::finishInit()
+	{
+		if (!mInitError.empty())
+		{
+			Logger::info(mInitError);
+			mInitError.clear();
+			return;
+		}
+		
+		// The chunk runs on the main thread, where the shared bindings are added.
+		utility::ErrorState error_state;
+		if (mInitMode == ELuaInitMode::Parallel && !load(error_state))
+			Logger::info(error_state.toString());
+	}
+	
+	
+	void LuaScript::onDestroy()
+	{
+		// A script destroyed before it was used isn't run anymore.
+		mInitPending = false;
+		waitForUpdate();
+		if (mService != nullptr)
+			mService->unregisterScript(*this);
+		disconnectSignals();
+		releaseBytecode();
+		
+		if (L != nullptr)
+		{
+			mScheduler.clear();
+			lua_close(L);
+		}
+		L = nullptr;
+		mChunkRef = LUA_NOREF;
+		mEnvironmentRef = LUA_NOREF;
+		mCallStatsIndicesRef = LUA_NOREF;
+		mInputsRef = LUA_NOREF;
+		mOutputsRef = LUA_NOREF;
+		mViewsRef = LUA_NOREF;
+		mInputEventView = nullptr;
+		mInputEventViewRef = LUA_NOREF;
+		mInputChannelsRef = LUA_NOREF;
+		mOutputChannelsRef = LUA_NOREF;
+		mInputViews.clear();
+		mOutputViews.clear();
+	}
+	
+	
+	void LuaScript::releaseBytecode()
+	{
+		if (!mBytecodeUser)
+			return;
+		mService->getBytecodeCache().removeUser(mPath);
+		mBytecodeUser = false;
+	}
+	
+	
+	bool LuaScript::compile(const MappedFile& file, const LuaSourceVersion& version, utility::ErrorState& errorState)
+	{
+		// Load the chunk another script of the service precompiled from the same version of the file, otherwise parse the mapping into a function.
+		LuaBytecodeCache::Bytecode bytecode;
+		if (mService != nullptr)
+			bytecode = mService->getBytecodeCache().find(mPath, version);
+		
+		ChunkReader reader;
+		reader.mData = bytecode != nullptr ? bytecode->data() : file.getData();
+		reader.mSize = bytecode != nullptr ? bytecode->size() : file.getSize();
+		std::string chunk_name = "@" + mPath;
+		if (mTracer.isRunning())
+			mTracer.begin(LuaTracer::ECategory::Compile, mPath.c_str());
+		int r = luacompat::load(L, &readChunk, &reader, chunk_name.c_str());
+		if (mTracer.isRunning())
+			mTracer.end(LuaTracer::ECategory::Compile);
+		
+		if (r != LUA_OK)
+		{
+			mValid = false;
+			errorState.fail("Lua script invalid: %s", lua_tostring(L, -1));
+			lua_pop(L, 1);
+			return false;
+		}
+		
+		// Share the compiled function with the other scripts of the service that load the file.
+		if (mService != nullptr && bytecode == nullptr && (mShareBytecode || mService->getBytecodeCache().getUserCount(mPath) > 1))
+		{
+			auto dumped = std::make_shared<std::vector<char>>();
+			if (luacompat::dump(L, &writeChunk, dumped.get()) == 0)
+				mService->getBytecodeCache().store(mPath, version, std::move(dumped));
+		}
+		
+		// Keep the compiled function, replacing the previous one.
+		luaL_unref(L, LUA_REGISTRYINDEX, mChunkRef);
+		mChunkRef = luaL_ref(L, LUA_REGISTRYINDEX);
 		return true;
 	}
 	
 	
 	bool LuaScript::load(utility::ErrorState& errorState)
 	{
-		// Load the script.
-		int r = luaL_dostring(L, mScriptAsString.c_str());
+		waitForUpdate();
+		StateScope state_scope(*this);
+		
+		// Only read the file when its size or modification time changed, and only parse it again when its contents changed since it was last compiled.
+		// A file that can't be read anymore keeps running the chunk that was compiled last.
+		LuaFileStamp stamp;
+		MappedFile file;
+		utility::ErrorState open_error;
+		if (LuaFileStamp::get(mPath, stamp) && stamp != mSourceStamp && file.open(mPath, open_error))
+		{
+			LuaSourceVersion version = LuaSourceVersion::get(file.getData(), file.getSize());
+			if (version != mSourceVersion)
+			{
+				if (!compile(file, version, errorState))
+					return false;
+				mSourceVersion = version;
+			}
+			mSourceStamp = stamp;
+			file.close();
+		}
+		return runChunk(errorState);
+	}
+	
+	
+	bool LuaScript::runChunk(utility::ErrorState& errorState)
+	{
+		if (mChunkRef == LUA_NOREF)
+		{
+			mValid = false;
+			errorState.fail("Lua script invalid: %s failed to compile", mPath.c_str());
+			return false;
+		}
+		
+		// The tasks of the previous run stop, the script starts its tasks again. Emissions meant for the previous run are dropped.
+		mScheduler.clear();
+		for (auto& connection : mSignalConnections)
+			connection->clear();
+		
+		// Run the compiled chunk.
+		lua_rawgeti(L, LUA_REGISTRYINDEX, mChunkRef);
+		if (mFreshEnvironment)
+		{
+			// Create a new environment that falls back on the real globals for libraries and bindings.
+			lua_newtable(L);
+			lua_newtable(L);
+			lua_pushglobaltable(L);
+			lua_setfield(L, -2, "__index");
+			lua_setmetatable(L, -2);
+			
+			// Keep it for variable lookups and make it the environment of the chunk.
+			lua_pushvalue(L, -1);
+			luaL_unref(L, LUA_REGISTRYINDEX, mEnvironmentRef);
+			mEnvironmentRef = luaL_ref(L, LUA_REGISTRYINDEX);
+			luacompat::setEnvironment(L, -2);
+		}
+		CallScope call_scope(*this, sLoadIdentifier, LuaTracer::ECategory::Load, -1);
+		int r = lua_pcall(L, 0, 0, 0);
 		if (r != LUA_OK)
 		{
 			mValid = false;
 			errorState.fail("Lua script invalid: %s", lua_tostring(L, -1));
+			lua_pop(L, 1);
 			return false;
 		}
 		
+		// The script starts from scratch, an event-driven script computes its outputs again.
 		mValid = true;
+		mDirty = true;
+		return true;
+	}
+	
+	
+	luabridge::LuaRef LuaScript::getGlobal(const std::string& identifier)
+	{
+		if (mEnvironmentRef == LUA_NOREF)
+			return luabridge::getGlobal(L, identifier.c_str());
+		
+		lua_rawgeti(L, LUA_REGISTRYINDEX, mEnvironmentRef);
+		lua_getfield(L, -1, identifier.c_str());
+		lua_remove(L, -2);
+		return luabridge::LuaRef::fromStack(L);
+	}
+	
+	
+	void LuaScript::setBuffer(const std::string& identifier, void* data, size_t size)
+	{
+		waitForUpdate();
+		
+		// Stored in the real globals, so it stays visible when the script is loaded in a fresh environment.
+		lua_createtable(L, 0, 2);
+		lua_pushlightuserdata(L, data);
+		lua_setfield(L, -2, "data");
+		lua_pushnumber(L, static_cast<lua_Number>(size));
+		lua_setfield(L, -2, "size");
+		lua_setglobal(L, identifier.c_str());
+	}
+	
+	
+	bool LuaScript::setTransform(const std::string& identifier, TransformComponentInstance& transform, utility::ErrorState& errorState)
+	{
+		if (!checkHandleThread(identifier, errorState))
+			return false;
+		
+		waitForUpdate();
+		LuaTransform::push(L, transform);
+		lua_setglobal(L, identifier.c_str());
 		return true;
 	}
+	
+	
+	bool LuaScript::setTransforms(const std::string& identifier, const std::vector<TransformComponentInstance*>& transforms, utility::ErrorState& errorState)
+	{
+		if (!checkHandleThread(identifier, errorState))
+			return false;
+		
+		waitForUpdate();
+		LuaTransformList::push(L, transforms);
+		lua_setglobal(L, identifier.c_str());
+		return true;
+	}
+	
+	
+	bool LuaScript::checkHandleThread(const std::string& identifier, utility::ErrorState& errorState) const
+	{
+		// The update of an asynchronous script and the blocks of a real-time script run while the main thread renders.
+		return errorState.check(!mAsynchronous && !mRealTime, "%s: can't expose \"%s\", handles can only be given to scripts that run on the main thread", mPath.c_str(), identifier.c_str());
+	}
+	
+	
+	int LuaScript::processCalls()
+	{
+		waitForUpdate();
+		
+		// Bounded by the capacity, so producers that keep queueing can't stall the owning thread.
+		LuaCallQueue::Call call;
+		int count = 0;
+		std::string identifier;
+		while (count < mCallQueue.getCapacity() && mCallQueue.pop(call))
+		{
+			count++;
+			identifier = call.mFunction;
+			utility::ErrorState error_state;
+			if (!callValues(identifier, call.mArguments, call.mArgumentCount, error_state))
+				Logger::warn(error_state.toString());
+		}
+		return count;
+	}
+	
+	
+	bool LuaScript::callValues(const std::string& identifier, const LuaValue* args, int count, utility::ErrorState& errorState)
+	{
+		if (!mValid || !checkQuarantine(identifier, errorState))
+			return false;
+		
+		luabridge::LuaRef func = getGlobal(identifier);
+		if (!func.isFunction())
+		{
+			errorState.fail("Error calling Lua function \"%s\": not a function", identifier.c_str());
+			return false;
+		}
+		
+		func.push(L);
+		for (int i = 0; i < count; i++)
+			args[i].push(L);
+		
+		CallScope call_scope(*this, identifier, LuaTracer::ECategory::Call, -(count + 1));
+		if (lua_pcall(L, count, 0, 0) != LUA_OK)
+		{
+			failCall(identifier, errorState, lua_tostring(L, -1));
+			lua_pop(L, 1);
+			return false;
+		}
+		return true;
+	}
+	
+	
+	bool LuaScript::processBlock(const float* const* inputs, int inputChannelCount, float* const* outputs, int outputChannelCount, int frameCount)
+	{
+		if (!mArena.isAllocated())
+			return false;
+		
+		// Never wait on the real-time thread: skip the block while another thread holds the state.
+		EStateOwner owner = EStateOwner::None;
+		if (!mStateOwner.compare_exchange_strong(owner, EStateOwner::RealTime, std::memory_order_acquire))
+		{
+			mSkippedBlocks.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		
+		if (!mValid)
+		{
+			mStateOwner.store(EStateOwner::None, std::memory_order_release);
+			return false;
+		}
+		
+		// Calls queued by other threads are made before the block, bounded like processCalls().
+		LuaCallQueue::Call call;
+		int count = 0;
+		while (count < mCallQueue.getCapacity() && mCallQueue.pop(call))
+		{
+			count++;
+			mQueuedFunction.assign(call.mFunction);
+			if (!pushRealTimeFunction(mQueuedFunction))
+				continue;
+			for (int i = 0; i < call.mArgumentCount; i++)
+				call.mArguments[i].push(L);
+			callRealTime(mQueuedFunction, call.mArgumentCount);
+		}
+		
+		bool processed = false;
+		if (pushRealTimeFunction(mProcessFunction))
+		{
+			setChannels(inputs, inputChannelCount, outputs, outputChannelCount, frameCount);
+			lua_rawgeti(L, LUA_REGISTRYINDEX, mInputChannelsRef);
+			lua_rawgeti(L, LUA_REGISTRYINDEX, mOutputChannelsRef);
+			lua_pushinteger(L, frameCount);
+			processed = callRealTime(mProcessFunction, 3);
+		}
+		
+		mStateOwner.store(EStateOwner::None, std::memory_order_release);
+		return processed;
+	}
+	
+	
+	bool LuaScript::collectGarbage(int kilobytes)
+	{
+		StateScope state_scope(*this);
+		return stepGarbageCollector(kilobytes);
+	}
+	
+	
+	bool LuaScript::takeRealTimeError(std::string& outError)
+	{
+		if (!mRealTimeErrorPending.load(std::memory_order_acquire))
+			return false;
+		
+		outError = mRealTimeError.data();
+		mRealTimeErrorPending.store(false, std::memory_order_release);
+		return true;
+	}
+	
+	
+	bool LuaScript::pushRealTimeFunction(const std::string& identifier)
+	{
+		// The name is interned already when the function exists, so looking it up doesn't allocate.
+		if (mEnvironmentRef == LUA_NOREF)
+		{
+			lua_getglobal(L, identifier.c_str());
+		}
+		else
+		{
+			lua_rawgeti(L, LUA_REGISTRYINDEX, mEnvironmentRef);
+			lua_getfield(L, -1, identifier.c_str());
+			lua_remove(L, -2);
+		}
+		
+		if (lua_isfunction(L, -1))
+			return true;
+		lua_pop(L, 1);
+		setRealTimeError(identifier, "not a function");
+		return false;
+	}
+	
+	
+	bool LuaScript::callRealTime(const std::string& identifier, int argumentCount)
+	{
+		CallScope call_scope(*this, identifier, LuaTracer::ECategory::Call, -(argumentCount + 1));
+		if (lua_pcall(L, argumentCount, 0, 0) == LUA_OK)
+			return true;
+		
+		setRealTimeError(identifier, mBudgetExceeded ? "exceeded its execution budget" : lua_tostring(L, -1));
+		mBudgetExceeded = false;
+		lua_pop(L, 1);
+		return false;
+	}
+	
+	
+	void LuaScript::setRealTimeError(const std::string& identifier, const char* error)
+	{
+		mRealTimeErrorCount.fetch_add(1, std::memory_order_relaxed);
+		if (mRealTimeErrorPending.load(std::memory_order_acquire))
+			return;
+		
+		// Formatted into the fixed buffer, an ErrorState would allocate.
+		std::snprintf(mRealTimeError.data(), mRealTimeError.size(), "%s: error calling Lua function \"%s\" on the real-time thread: %s",
+			mPath.c_str(), identifier.c_str(), error != nullptr ? error : "unknown error");
+		mRealTimeErrorPending.store(true, std::memory_order_release);
+	}
+	
+	
+	void LuaScript::setChannels(const float* const* inputs, int inputChannelCount, float* const* outputs, int outputChannelCount, int frameCount)
+	{
+		inputChannelCount = std::min(inputChannelCount, mMaxChannels);
+		outputChannelCount = std::min(outputChannelCount, mMaxChannels);
+		for (int i = 0; i < mMaxChannels; i++)
+		{
+			// Input views are read only, so the samples are never written through them.
+			// Views of unused channels are emptied, in case the script kept a reference to them.
+			bool input = i < inputChannelCount;
+			mInputViews[i]->mData = input ? const_cast<float*>(inputs[i]) : nullptr;
+			mInputViews[i]->mSize = input ? frameCount : 0;
+			bool output = i < outputChannelCount;
+			mOutputViews[i]->mData = output ? outputs[i] : nullptr;
+			mOutputViews[i]->mSize = output ? frameCount : 0;
+		}
+		
+		if (inputChannelCount == mInputChannelCount && outputChannelCount == mOutputChannelCount)
+			return;
+		
+		// Assigning existing array slots doesn't allocate.
+		lua_rawgeti(L, LUA_REGISTRYINDEX, mViewsRef);
+		lua_rawgeti(L, LUA_REGISTRYINDEX, mInputChannelsRef);
+		lua_rawgeti(L, LUA_REGISTRYINDEX, mOutputChannelsRef);
+		for (int i = 0; i < mMaxChannels; i++)
+		{
+			if (i < inputChannelCount)
+				lua_rawgeti(L, -3, i + 1);
+			else
+				lua_pushnil(L);
+			lua_rawseti(L, -3, i + 1);
+			
+			if (i < outputChannelCount)
+				lua_rawgeti(L, -3, mMaxChannels + i + 1);
+			else
+				lua_pushnil(L);
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_pop(L, 3);
+		mInputChannelCount = inputChannelCount;
+		mOutputChannelCount = outputChannelCount;
+	}
+	
+	
+	void LuaScript::createBufferViews()
+	{
+		// All views stay referenced by one table, the channel tables only hold the views of the current block.
+		lua_createtable(L, mMaxChannels * 2, 0);
+		lua_createtable(L, mMaxChannels, 0);
+		lua_createtable(L, mMaxChannels, 0);
+		for (int i = 0; i < mMaxChannels; i++)
+		{
+			mInputViews.emplace_back(LuaBufferView::push(L, false));
+			lua_pushvalue(L, -1);
+			lua_rawseti(L, -5, i + 1);
+			lua_rawseti(L, -3, i + 1);
+		}
+		for (int i = 0; i < mMaxChannels; i++)
+		{
+			mOutputViews.emplace_back(LuaBufferView::push(L, true));
+			lua_pushvalue(L, -1);
+			lua_rawseti(L, -5, mMaxChannels + i + 1);
+			lua_rawseti(L, -2, i + 1);
+		}
+		mInputChannelCount = mMaxChannels;
+		mOutputChannelCount = mMaxChannels;
+		mOutputChannelsRef = luaL_ref(L, LUA_REGISTRYINDEX);
+		mInputChannelsRef = luaL_ref(L, LUA_REGISTRYINDEX);
+		mViewsRef = luaL_ref(L, LUA_REGISTRYINDEX);
+	}
+	
+	
+	bool LuaScript::startTask(const std::string& identifier, utility::ErrorState& errorState, std::initializer_list<LuaValue> args)
+	{
+		waitForUpdate();
+		if (!errorState.check(mValid, "Error starting Lua task \"%s\": the script is invalid", identifier.c_str()))
+			return false;
+		
+		luabridge::LuaRef func = getGlobal(identifier);
+		if (!func.isFunction())
+		{
+			errorState.fail("Error starting Lua task \"%s\": not a function", identifier.c_str());
+			return false;
+		}
+		
+		func.push(L);
+		for (const auto& arg : args)
+			arg.push(L);
+		CallScope call_scope(*this, identifier, LuaTracer::ECategory::Call, -(static_cast<int>(args.size()) + 1));
+		mScheduler.start(L, static_cast<int>(args.size()));
+		mBudgetExceeded = false;
+		return true;
+	}
+	
+	
+	std::shared_ptr<LuaFuture> LuaScript::runAsync(LuaFuture::Work work)
+	{
+		// The future is shared with the worker, so it outlives the script when the script is destroyed first.
+		auto future = std::make_shared<LuaFuture>();
+		if (mService != nullptr)
+			mService->getThreadPool().submit([future, work = std::move(work)]() { future->run(work); });
+		else
+			future->run(work);
+		return future;
+	}
+	
+	
+	void LuaScript::updateTasks(double deltaTime)
+	{
+		waitForUpdate();
+		if (mScheduler.getTaskCount() == 0)
+			return;
+		
+		CallScope call_scope(*this, sTasksIdentifier);
+		mScheduler.update(deltaTime);
+		mBudgetExceeded = false;
+	}
+	
+	
+	void LuaScript::emitSignal(const std::string& name)
+	{
+		waitForUpdate();
+		mScheduler.emitSignal(name);
+		if (mEventDriven && std::find(mSignalNames.begin(), mSignalNames.end(), name) != mSignalNames.end())
+			mDirty = true;
+	}
+	
+	
+	void LuaScript::setInput(const std::string& name, const LuaValue& value)
+	{
+		LuaValue& input = mInputs[name];
+		if (input == value)
+			return;
+		
+		input = value;
+		if (mEventDriven && (mInputNames.empty() || std::find(mInputNames.begin(), mInputNames.end(), name) != mInputNames.end()))
+			mDirty = true;
+	}
+	
+	
+	bool LuaScript::setUniform(const std::string& identifier, UniformFloatInstance& uniform, utility::ErrorState& errorState)
+	{
+		if (!checkHandleThread(identifier, errorState))
+			return false;
+		
+		waitForUpdate();
+		LuaUniform::push(L, uniform);
+		lua_setglobal(L, identifier.c_str());
+		return true;
+	}
+	
+	
+	bool LuaScript::setUniform(const std::string& identifier, UniformVec3Instance& uniform, utility::ErrorState& errorState)
+	{
+		if (!checkHandleThread(identifier, errorState))
+			return false;
+		
+		waitForUpdate();
+		LuaUniform::push(L, uniform);
+		lua_setglobal(L, identifier.c_str());
+		return true;
+	}
+	
+	
+	bool LuaScript::setUniformStruct(const std::string& identifier, UniformStructInstance& uniformStruct, const std::vector<std::string>& members, utility::ErrorState& errorState)
+	{
+		std::vector<LuaUniform> resolved;
+		if (!checkHandleThread(identifier, errorState) || !LuaUniformStruct::resolve(uniformStruct, members, resolved, errorState))
+			return false;
+		
+		waitForUpdate();
+		LuaUniformStruct::push(L, resolved);
+		lua_setglobal(L, identifier.c_str());
+		return true;
+	}
+	
+	
+	bool LuaScript::deliverInput(const LuaInputEvent* events, int count, const std::string& handler, utility::ErrorState& errorState)
+	{
+		waitForUpdate();
+		if (mInputEventViewRef == LUA_NOREF)
+		{
+			mInputEventView = LuaInputEventView::push(L);
+			mInputEventViewRef = luaL_ref(L, LUA_REGISTRYINDEX);
+		}
+		
+		mInputEventView->mEvents = events;
+		mInputEventView->mCount = count;
+		lua_rawgeti(L, LUA_REGISTRYINDEX, mInputEventViewRef);
+		luabridge::LuaRef view = luabridge::LuaRef::fromStack(L);
+		bool result = callVoid(handler, errorState, view);
+		
+		// A script that keeps the view sees no events once the array is reused.
+		mInputEventView->mEvents = nullptr;
+		mInputEventView->mCount = 0;
+		return result;
+	}
+	
+	
+	void LuaScript::disconnectSignal(LuaSignalConnection& connection)
+	{
+		mSignalConnections.erase(std::remove_if(mSignalConnections.begin(), mSignalConnections.end(),
+			[&connection](const auto& c) { return c.get() == &connection; }), mSignalConnections.end());
+	}
+	
+	
+	void LuaScript::disconnectSignals()
+	{
+		mSignalConnections.clear();
+	}
+	
+	
+	void LuaScript::deliverSignals()
+	{
+		if (mSignalConnections.empty())
+			return;
+		
+		waitForUpdate();
+		for (auto& connection : mSignalConnections)
+			connection->deliver();
+	}
+	
+	
+	LuaValue LuaScript::getOutput(const std::string& name) const
+	{
+		const auto& outputs = mOutputs[mFrontOutputs];
+		auto it = outputs.find(name);
+		return it != outputs.end() ? it->second : LuaValue();
+	}
+	
+	
+	void LuaScript::startUpdate(double deltaTime)
+	{
+		waitForUpdate();
+		if (!mValid)
+			return;
+		
+		// An unchanged event-driven script keeps the outputs of its last update.
+		if (mEventDriven)
+		{
+			if (!mDirty)
+			{
+				mSkippedDeltaTime += deltaTime;
+				return;
+			}
+			deltaTime += mSkippedDeltaTime;
+			mSkippedDeltaTime = 0.0;
+			mDirty = false;
+		}
+		
+		// No update runs now, so the inputs can be written into the state: the update reads this snapshot.
+		lua_rawgeti(L, LUA_REGISTRYINDEX, mInputsRef);
+		for (const auto& [name, value] : mInputs)
+		{
+			value.push(L);
+			lua_setfield(L, -2, name.c_str());
+		}
+		lua_pop(L, 1);
+		
+		mUpdateDeltaTime = deltaTime;
+		if (mService != nullptr && mAsynchronous)
+			mUpdate = mService->getThreadPool().submit([this]() { runUpdate(); });
+		else
+			runUpdate();
+	}
+	
+	
+	void LuaScript::finishUpdate()
+	{
+		waitForUpdate();
+		if (!mUpdateFinished)
+			return;
+		
+		mUpdateFinished = false;
+		mFrontOutputs = 1 - mFrontOutputs;
+		if (!mUpdateError.empty())
+		{
+			Logger::warn(mUpdateError);
+			mUpdateError.clear();
+		}
+	}
+	
+	
+	void LuaScript::waitForUpdate()
+	{
+		// The update itself may call back into the script through bound C++ functions.
+		if (sUpdatingScript == this || !mUpdate.valid())
+			return;
+		
+		try
+		{
+			mUpdate.get();
+		}
+		catch (const std::exception& e)
+		{
+			mUpdateError = e.what();
+		}
+		
+		if (mInitPending)
+		{
+			mInitPending = false;
+			finishInit();
+		}
+	}
+	
+	
+	void LuaScript::runUpdate()
+	{
+		sUpdatingScript = this;
+		
+		lua_rawgeti(L, LUA_REGISTRYINDEX, mInputsRef);
+		luabridge::LuaRef inputs = luabridge::LuaRef::fromStack(L);
+		lua_rawgeti(L, LUA_REGISTRYINDEX, mOutputsRef);
+		luabridge::LuaRef outputs = luabridge::LuaRef::fromStack(L);
+		
+		utility::ErrorState error_state;
+		if (!callVoid(mUpdateFunction, error_state, mUpdateDeltaTime, inputs, outputs))
+			mUpdateError = error_state.toString();
+		
+		// Copy the outputs into the back buffer, the main thread reads the front buffer.
+		// The back buffer holds the outputs of two updates ago, keys the script removed since then must not come back.
+		auto& back_outputs = mOutputs[1 - mFrontOutputs];
+		back_outputs.clear();
+		lua_rawgeti(L, LUA_REGISTRYINDEX, mOutputsRef);
+		if (mOutputNames.empty())
+		{
+			lua_pushnil(L);
+			while (lua_next(L, -2) != 0)
+			{
+				if (lua_type(L, -2) == LUA_TSTRING)
+					back_outputs[lua_tostring(L, -2)] = LuaValue::fromStack(L, -1);
+				lua_pop(L, 1);
+			}
+		}
+		else
+		{
+			for (const auto& name : mOutputNames)
+			{
+				lua_getfield(L, -1, name.c_str());
+				back_outputs[name] = LuaValue::fromStack(L, -1);
+				lua_pop(L, 1);
+			}
+		}
+		lua_pop(L, 1);
+		
+		mUpdateFinished = true;
+		sUpdatingScript = nullptr;
+	}
+	
+	
+	LuaScript::CallScope::CallScope(LuaScript& script, const std::string& identifier, LuaTracer::ECategory category, int function) :
+		mScript(script), mIdentifier(identifier), mCategory(category), mOutermost(script.mCallDepth++ == 0),
+		mTimed(mOutermost && (script.mProfiler.isRunning() || script.mCallStats.isEnabled())), mTraced(script.mTracer.isRunning()),
+		mBudgeted(mOutermost && category == LuaTracer::ECategory::Call && script.hasBudget())
+	{
+		// The budget starts with the outermost call into Lua.
+		if (mBudgeted)
+		{
+			mScript.mBudgetActive = true;
+			mScript.mInstructionsExecuted = 0;
+			mScript.mBudgetExceeded = false;
+			if (mScript.mTimeBudget > 0.0f)
+				mScript.mDeadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float, std::milli>(mScript.mTimeBudget));
+		}
+		
+		// Allocations that are still pending were made from C++, not by the function that is called now.
+		if (mScript.mMemoryProfiler.hasPending())
+			mScript.mMemoryProfiler.resolve(nullptr);
+		
+		if (mTraced)
+			mScript.mTracer.begin(mCategory, mIdentifier.c_str());
+		
+		// Resolved before the call is timed, recording only takes the index.
+		if (mTimed && mScript.mCallStats.isEnabled())
+			mStatsIndex = function != 0 ? mScript.getCallStatsIndex(function, mIdentifier) : mScript.mCallStats.getIndex(mIdentifier);
+		
+		// Only the outermost call is timed, the time of nested calls is part of it and would be counted twice.
+		if (mTimed)
+			mStart = std::chrono::steady_clock::now();
+	}
+	
+	
+	LuaScript::CallScope::~CallScope()
+	{
+		mScript.mCallDepth--;
+		if (mBudgeted)
+			mScript.mBudgetActive = false;
+		
+		if (mTraced)
+		{
+			mScript.mTracer.closeNativeEvents();
+			mScript.mTracer.end(mCategory);
+		}
+		
+		if (!mTimed)
+			return;
+		
+		auto duration = std::chrono::steady_clock::now() - mStart;
+		if (mScript.mProfiler.isRunning())
+			mScript.mProfiler.addTime(std::chrono::duration<double>(duration).count());
+		if (mScript.mCallStats.isEnabled())
+			mScript.mCallStats.record(mStatsIndex, std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+	}
+	
+	
+	LuaScript::CallScope::CallScope(LuaScript& script, const std::string& identifier, const luabridge::LuaRef& function) :
+		CallScope(script, identifier, LuaTracer::ECategory::Call, pushFunction(script, function))
+	{
+		if (mTimed && mScript.mCallStats.isEnabled())
+			lua_pop(mScript.L, 1);
+	}
+	
+	
+	int LuaScript::CallScope::pushFunction(LuaScript& script, const luabridge::LuaRef& function)
+	{
+		// Evaluated before the call depth of the scope is counted.
+		if (script.mCallDepth != 0 || !script.mCallStats.isEnabled())
+			return 0;
+		function.push(script.L);
+		return -1;
+	}
+	
+	
+	LuaScript::StateScope::StateScope(LuaScript& script) :
+		mScript(script)
+	{
+		if (!mScript.mArena.isAllocated())
+			return;
+		
+		// Waits for the block that is being processed, the real-time thread skips blocks until the scope ends.
+		auto owner = EStateOwner::None;
+		while (!mScript.mStateOwner.compare_exchange_weak(owner, EStateOwner::Other, std::memory_order_acquire))
+		{
+			owner = EStateOwner::None;
+			std::this_thread::yield();
+		}
+	}
+	
+	
+	LuaScript::StateScope::~StateScope()
+	{
+		if (mScript.mArena.isAllocated())
+			mScript.mStateOwner.store(EStateOwner::None, std::memory_order_release);
+	}
+	
+	
+	bool LuaScript::checkQuarantine(const std::string& identifier, utility::ErrorState& errorState)
+	{
+		if (mQuarantined.empty() || mQuarantined.find(identifier) == mQuarantined.end())
+			return true;
+		
+		errorState.fail("Lua function \"%s\" is quarantined until the next frame: it exceeded its execution budget", identifier.c_str());
+		return false;
+	}
+	
+	
+	void LuaScript::failCall(const std::string& identifier, utility::ErrorState& errorState, const char* error)
+	{
+		if (!mBudgetExceeded)
+		{
+			errorState.fail("Error calling Lua function \"%s\": %s", identifier.c_str(), error);
+			return;
+		}
+		
+		errorState.fail("Lua function \"%s\" aborted: exceeded its execution budget of %d instructions / %.02fms", identifier.c_str(), mInstructionBudget, mTimeBudget);
+		mBudgetExceeded = false;
+		if (mQuarantine)
+			mQuarantined.emplace(identifier);
+	}
+	
+	
+	int LuaScript::getCallStatsIndex(int function, const std::string& identifier)
+	{
+		function = luacompat::absIndex(L, function);
+		lua_rawgeti(L, LUA_REGISTRYINDEX, mCallStatsIndicesRef);
+		lua_pushvalue(L, function);
+		lua_rawget(L, -2);
+		if (!lua_isnil(L, -1))
+		{
+			int index = static_cast<int>(lua_tointeger(L, -1));
+			lua_pop(L, 2);
+			return index;
+		}
+		
+		// The first call of the function, functions that are not recorded are stored as well so they are not looked up again.
+		int index = mCallStats.getIndex(identifier);
+		lua_pop(L, 1);
+		lua_pushvalue(L, function);
+		lua_pushinteger(L, index);
+		lua_rawset(L, -3);
+		lua_pop(L, 1);
+		return index;
+	}
+	
+	
+	void LuaScript::checkBudget(lua_State* L, int instructions)
+	{
+		if (!mBudgetActive)
+			return;
+		
+		mInstructionsExecuted += instructions;
+		bool exceeded = (mInstructionBudget > 0 && mInstructionsExecuted > mInstructionBudget) ||
+			(mTimeBudget > 0.0f && std::chrono::steady_clock::now() > mDeadline);
+		if (!exceeded)
+			return;
+		
+		// Keeps raising, also when the script catches the error with pcall.
+		mBudgetExceeded = true;
+		luaL_error(L, "execution budget exceeded");
+	}
+	
+	
+	void LuaScript::nextFrame()
+	{
+		waitForUpdate();
+		mQuarantined.clear();
+		mCallStats.nextFrame();
+		mMemoryProfiler.nextFrame();
+	}
+	
+	
+	void LuaScript::setBudget(int instructions, float milliseconds)
+	{
+		waitForUpdate();
+		mInstructionBudget = instructions;
+		mTimeBudget = milliseconds;
+		updateHook();
+	}
+	
+	
+	void LuaScript::startProfiling(int sampleInterval)
+	{
+		waitForUpdate();
+		mProfiler.start(sampleInterval);
+		updateHook();
+	}
+	
+	
+	void LuaScript::stopProfiling()
+	{
+		waitForUpdate();
+		mProfiler.stop();
+		updateHook();
+	}
+	
+	
+	void LuaScript::startMemoryProfiling(int sampleInterval)
+	{
+		waitForUpdate();
+		mMemoryProfiler.start(sampleInterval);
+		updateHook();
+	}
+	
+	
+	void LuaScript::stopMemoryProfiling()
+	{
+		waitForUpdate();
+		mMemoryProfiler.resolve(nullptr);
+		mMemoryProfiler.stop();
+		updateHook();
+	}
+	
+	
+	void LuaScript::startTracing(int capacity)
+	{
+		waitForUpdate();
+		mTracer.start(capacity);
+		updateHook();
+	}
+	
+	
+	void LuaScript::stopTracing()
+	{
+		waitForUpdate();
+		mTracer.stop();
+		updateHook();
+	}
+	
+	
+	bool LuaScript::stepGarbageCollector(int kilobytes)
+	{
+		waitForUpdate();
+		if (mTracer.isRunning())
+			mTracer.begin(LuaTracer::ECategory::GC, "step");
+		bool finished_cycle = lua_gc(L, LUA_GCSTEP, kilobytes) != 0;
+		if (mTracer.isRunning())
+			mTracer.end(LuaTracer::ECategory::GC);
+		return finished_cycle;
+	}
+	
+	
+	void LuaScript::setGCMode(ELuaGCMode mode)
+	{
+		waitForUpdate();
+		mGCMode = mode;
+		updateGarbageCollector();
+	}
+	
+	
+	void LuaScript::updateGarbageCollector()
+	{
+		if (L == nullptr)
+			return;
+		
+		if (mGCMode == ELuaGCMode::Generational)
+		{
+			if (luacompat::setGenerationalGC(L, mGCMinorMultiplier, mGCMajorMultiplier))
+				return;
+			Logger::warn("%s: %s has no generational garbage collector, using the incremental collector", mPath.c_str(), luacompat::getVersion());
+			mGCMode = ELuaGCMode::Incremental;
+		}
+		luacompat::setIncrementalGC(L, mGCPause, mGCStepMultiplier);
+	}
+	
+	
+	void LuaScript::updateHook()
+	{
+		if (L == nullptr)
+			return;
+		
+		// Combine the events the active tools need into a single hook, counting at the finest interval any of them needs.
+		int mask = 0;
+		int count = 0;
+		if (mProfiler.isRunning())
+		{
+			mask |= LUA_MASKCOUNT;
+			count = mProfiler.getSampleInterval();
+			mInstructionsUntilSample = count;
+		}
+		if (hasBudget())
+		{
+			int interval = mInstructionBudget > 0 ? std::min(mInstructionBudget, sBudgetCheckInterval) : sBudgetCheckInterval;
+			count = count > 0 ? std::min(count, interval) : interval;
+			mask |= LUA_MASKCOUNT;
+		}
+		if (mTracer.isRunning())
+			mask |= LUA_MASKCALL | LUA_MASKRET;
+		
+		// Coroutines copy the hook when they are created, the tasks that are alive now get the new hook as well.
+		mHookMask = mask;
+		mHookCount = count;
+		setHook(L);
+		for (lua_State* thread : mScheduler.getThreads())
+			setHook(thread);
+	}
+	
+	
+	void LuaScript::setHook(lua_State* thread)
+	{
+		lua_sethook(thread, mHookMask != 0 ? &LuaScript::hook : nullptr, mHookMask, mHookCount);
+	}
+	
+	
+	void LuaScript::armMemoryHook()
+	{
+		// The state is still being created.
+		if (L == nullptr)
+			return;
+		
+		// lua_sethook may be called at any point, also from the allocator. Coroutines that are not tasks are not known here,
+		// their samples are resolved when the task or main state that resumed them runs its next instruction.
+		lua_State* thread = mScheduler.getCurrentThread();
+		lua_sethook(thread != nullptr ? thread : L, &LuaScript::hook, mHookMask | LUA_MASKCOUNT, 1);
+	}
+	
+	
+	void* LuaScript::allocate(void* userData, void* block, size_t oldSize, size_t newSize)
+	{
+		auto* script = static_cast<LuaScript*>(userData);
+		
+		// The old size is the type of the new object when there is no old block.
+		size_t old_size = block != nullptr ? oldSize : 0;
+		void* new_block = nullptr;
+		if (script->mArena.isAllocated())
+		{
+			// A real-time state never falls back on the system allocator, Lua raises a memory error instead.
+			new_block = script->mArena.reallocate(block, newSize);
+			if (new_block == nullptr && newSize != 0)
+				return nullptr;
+		}
+		else if (newSize == 0)
+		{
+			std::free(block);
+		}
+		else
+		{
+			new_block = std::realloc(block, newSize);
+			if (new_block == nullptr)
+				return nullptr;
+		}
+		
+		script->mAllocatedBytes = script->mAllocatedBytes - old_size + newSize;
+		if (script->mMemoryProfiler.isActive() && script->mMemoryProfiler.onAllocation(block, new_block, old_size, newSize))
+			script->armMemoryHook();
+		return new_block;
+	}
+	
+	
+	void LuaScript::hook(lua_State* L, lua_Debug* ar)
+	{
+		LuaScript* script = getScript(L);
+		if (script == nullptr)
+			return;
+		
+		if (ar->event == LUA_HOOKCOUNT)
+		{
+			// The hook runs on the thread that allocated, outside of the allocator, so its stack can be inspected.
+			if (script->mMemoryProfiler.hasPending())
+				script->mMemoryProfiler.resolve(L);
+			
+			// Armed by the allocator for a single instruction: restore the combined hook, which restarts its count.
+			// Threads created while it was armed copied it and are restored the first time they run.
+			if (lua_gethookcount(L) != script->mHookCount || lua_gethookmask(L) != script->mHookMask)
+			{
+				script->setHook(L);
+				if (script->hasBudget())
+					script->checkBudget(L, 1);
+				return;
+			}
+			
+			if (script->mProfiler.isRunning())
+			{
+				script->mInstructionsUntilSample -= script->mHookCount;
+				if (script->mInstructionsUntilSample <= 0)
+				{
+					script->mProfiler.sample(L);
+					script->mInstructionsUntilSample += script->mProfiler.getSampleInterval();
+				}
+			}
+			
+			// May not return.
+			if (script->hasBudget())
+				script->checkBudget(L, script->mHookCount);
+		}
+		else if (script->mTracer.isRunning())
+		{
+			script->mTracer.onHook(L, ar);
+		}
+	}
+	
+	
+	LuaScript* LuaScript::getScript(lua_State* L)
+	{
+		luacompat::rawGetPointer(L, LUA_REGISTRYINDEX, &sScriptKey);
+		auto* script = static_cast<LuaScript*>(lua_touserdata(L, -1));
+		lua_pop(L, 1);
+		return script;
+	}
 
 }
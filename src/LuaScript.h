@@ -6,21 +6,74 @@
 #pragma once
 
 #include <nap/resource.h>
+#include <nap/resourceptr.h>
 #include <nap/logger.h>
+#include <nap/numeric.h>
 
-extern "C" {
-	#include <lua.h>
-	#include <lualib.h>
-	#include <lauxlib.h>
-}
-
+#include "LuaCompat.h"
 #include "LuaBridge/LuaBridge.h"
+#include "LuaProfiler.h"
+#include "LuaCallStats.h"
+#include "LuaTracer.h"
+#include "LuaMemoryProfiler.h"
+#include "LuaBytecodeCache.h"
+#include "LuaValue.h"
+#include "LuaCallQueue.h"
+#include "LuaArena.h"
+#include "LuaBufferView.h"
+#include "LuaScheduler.h"
+#include "LuaFuture.h"
+#include "LuaChannel.h"
+#include "LuaTransform.h"
+#include "LuaUniform.h"
+#include "LuaSignal.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace nap
 {
 
+	class MappedFile;
+	class LuaService;
+	struct LuaInputEvent;
+	struct LuaInputEventView;
+
+	/**
+	 * Garbage collection mode of a Lua state.
+	 */
+	enum class ELuaGCMode : int
+	{
+		Incremental		= 0,	///< Collects in small steps interleaved with the script
+		Generational	= 1		///< Collects young objects often and old objects rarely, cheaper when most objects are short lived. Not available on LuaJIT.
+	};
+
+	/**
+	 * Where a script is created, compiled and run during initialisation.
+	 */
+	enum class ELuaInitMode : int
+	{
+		Serial		= 0,	///< On the main thread, in init()
+		Parallel	= 1,	///< Created and compiled on a worker thread of the LuaService, the script runs on the main thread when the resources are loaded or the script is first used
+		Background	= 2		///< Created, compiled and run on a worker thread, for scripts that don't use bindings shared with other objects
+	};
+	
 	/**
 	 * A Resource that manages a Lua script file.
+	 * 
+	 * An asynchronous script runs its per-frame update function on a worker thread of the LuaService, in parallel with rendering.
+	 * While the update runs, the Lua state belongs to the worker thread: every function of the script that accesses the state first waits for the update to finish.
+	 * The state is never used by two threads at once, but calling into an asynchronous script from the application update stalls the frame until its update is done.
+	 *
+	 * A real-time script runs block based process callbacks on an audio thread. Its state allocates from a preallocated arena and never collects garbage automatically:
+	 * collection runs in steps on another thread, with collectGarbage(), between two blocks.
+	 * Once processing started, only processBlock(), enqueueCall(), collectGarbage() and load() may be called while blocks are being processed.
+	 * Lua 5.4 collects garbage when an allocation fails, so real-time scripts are rejected by that backend.
 	 */
 	class NAPAPI LuaScript : public Resource
 	{
@@ -28,13 +81,41 @@ namespace nap
 		
 	public:
 		LuaScript() { };
+		LuaScript(LuaService& service) : mService(&service) { }
 		
 		std::string mPath; ///< Property: 'Path' Path to the Lua script.
+		int mTraceCapacity = 0; ///< Property: 'TraceCapacity' Number of events kept when tracing from initialisation on, 0 to not trace until startTracing() is called.
+		bool mFreshEnvironment = false; ///< Property: 'FreshEnvironment' Whether every load() runs the script in a new global environment, discarding the variables of the previous run. Bound C++ types and functions stay visible.
+		int mInstructionBudget = 0; ///< Property: 'InstructionBudget' Maximum number of Lua VM instructions a single call may execute before it is aborted, 0 for no limit.
+		float mTimeBudget = 0.0f; ///< Property: 'TimeBudget' Maximum duration of a single call in milliseconds before it is aborted, 0 for no limit.
+		bool mQuarantine = false; ///< Property: 'Quarantine' Whether a function that exceeded its budget is not called again for the rest of the frame.
+		ELuaGCMode mGCMode = ELuaGCMode::Incremental; ///< Property: 'GCMode' Garbage collection mode, falls back to incremental when the Lua implementation has no generational mode.
+		int mGCPause = 0; ///< Property: 'GCPause' Incremental mode: percentage the memory grows after a collection before a new cycle starts, 0 for the Lua default.
+		int mGCStepMultiplier = 0; ///< Property: 'GCStepMultiplier' Incremental mode: speed of the collector relative to allocation in percent, 0 for the Lua default.
+		int mGCMinorMultiplier = 0; ///< Property: 'GCMinorMultiplier' Generational mode: percentage the memory grows before a minor collection, 0 for the Lua default. Lua 5.4 only.
+		int mGCMajorMultiplier = 0; ///< Property: 'GCMajorMultiplier' Generational mode: percentage the memory grows beyond the last major collection before a new one, 0 for the Lua default.
+		bool mAsynchronous = false; ///< Property: 'Asynchronous' Whether the update function runs on a worker thread of the LuaService, in parallel with rendering.
+		std::string mUpdateFunction = "update"; ///< Property: 'UpdateFunction' Function called every frame when asynchronous, or when changed when event-driven, with the delta time, the inputs table and the outputs table.
+		int mCallQueueCapacity = 64; ///< Property: 'CallQueueCapacity' Maximum number of calls queued from other threads with enqueueCall(), 0 to not allocate a queue.
+		bool mRealTime = false; ///< Property: 'RealTime' Whether the script runs process callbacks on a real-time thread: it allocates from a fixed arena and only collects garbage through collectGarbage().
+		int mArenaSize = 4 * 1024 * 1024; ///< Property: 'ArenaSize' Size in bytes of the arena a real-time script allocates from, allocations that don't fit fail.
+		std::string mProcessFunction = "process"; ///< Property: 'ProcessFunction' Function called by processBlock(), with the input buffers, the output buffers and the number of frames.
+		int mMaxChannels = 8; ///< Property: 'MaxChannels' Maximum number of input and output channels passed to the process function.
+		ELuaInitMode mInitMode = ELuaInitMode::Serial; ///< Property: 'InitMode' Whether the state is created and the script compiled on a worker thread of the LuaService, real-time scripts always initialise serially.
+		bool mEventDriven = false; ///< Property: 'EventDriven' Whether the LuaService calls the update function only when an input, a signal in 'Signals' or invalidate() changed something since the last call. The outputs of the last call are kept in between.
+		std::vector<std::string> mInputNames; ///< Property: 'Inputs' Inputs that trigger the update of an event-driven script when set to a different value, empty for all inputs.
+		std::vector<std::string> mOutputNames; ///< Property: 'Outputs' Outputs copied from the outputs table after an update, empty for all string keys.
+		std::vector<std::string> mSignalNames; ///< Property: 'Signals' Signals emitted with emitSignal() that trigger the update of an event-driven script.
+		std::vector<ResourcePtr<LuaChannel>> mChannels; ///< Property: 'Channels' Channels the script sends and receives messages on, found in the global 'channels' table by ID. Not available to real-time scripts.
 		
 		bool init(utility::ErrorState& errorState) override;
+		
+		void onDestroy() override;
 				
 		/**
 		 * Loads the script. Called automatically during initialisation, but can also be called dynamically (for example, after binding a new C++ type which is used in the script)
+		 * Runs the compiled chunk again, the source is only parsed again when the contents of the file changed since it was last compiled.
+		 * The file is read and hashed on every call: its modification time can't tell two saves within the same second apart.
 		 * @param erorrState contains the error if loading the script fails
 		 * @return whether loading the script succeeded
 		 */
@@ -98,19 +179,659 @@ namespace nap
 		template <typename... Args>
 		bool callVoid(const std::string& identifier, utility::ErrorState& errorState, Args&... args);
 		
+		/**
+		 * Calls a Lua function once for every argument, looking the function up only once. The execution budget applies to the batch as a whole.
+		 * @param identifier the name of the function in Lua
+		 * @param errorState contains the error if one of the calls fails
+		 * @param args array of 'count' arguments, one for each call
+		 * @param outReturnValues array of 'count' return values, one for each call
+		 * @param count number of calls
+		 * @return whether all calls succeeded
+		 */
+		template <typename ReturnType, typename ArgType>
+		bool callBatch(const std::string& identifier, utility::ErrorState& errorState, const ArgType* args, ReturnType* outReturnValues, size_t count);
+		
+		/**
+		 * Calls a Lua function once for every argument, looking the function up only once. The execution budget applies to the batch as a whole.
+		 * @param identifier the name of the function in Lua
+		 * @param errorState contains the error if one of the calls fails
+		 * @param args the arguments, one for each call
+		 * @param outReturnValues the return values, resized to the number of arguments
+		 * @return whether all calls succeeded
+		 */
+		template <typename ReturnType, typename ArgType>
+		bool callBatch(const std::string& identifier, utility::ErrorState& errorState, const std::vector<ArgType>& args, std::vector<ReturnType>& outReturnValues);
+		
+		/**
+		 * Marks the start of a new frame: lifts the quarantine of functions that exceeded their budget and advances the per-frame call and allocation statistics.
+		 * The LuaService calls this every update before the queued calls are made, scripts that are not created by the service have to call it themselves.
+		 */
+		void nextFrame();
+		
+		/**
+		 * Queues a call to a Lua function, from any thread. The call is made when the owning thread processes the queue with processCalls() or processBlock(),
+		 * which the LuaService does at the start of every frame. Doesn't block or allocate: the call is dropped when the queue is full.
+		 * @param identifier the name of the function in Lua, at most LuaCallQueue::sMaxNameLength characters
+		 * @param args at most LuaCallQueue::sMaxArguments arguments
+		 * @return whether the call was queued
+		 */
+		bool enqueueCall(const char* identifier, std::initializer_list<LuaValue> args = {}) { return mCallQueue.push(identifier, args); }
+		
+		/**
+		 * Makes the calls that were queued with enqueueCall(), in the order they were queued. Errors are logged.
+		 * Only from the thread that owns the script. Calls that are queued while processing are made the next time.
+		 * @return number of calls made
+		 */
+		int processCalls();
+		
+		/**
+		 * @return the queue of calls from other threads, for its statistics
+		 */
+		const LuaCallQueue& getCallQueue() const { return mCallQueue; }
+		
+		/**
+		 * Starts a task that calls a Lua function as a coroutine, which runs until it waits. See LuaScheduler for the wait functions.
+		 * @param identifier the name of the function in Lua
+		 * @param errorState contains the error if the function doesn't exist
+		 * @param args arguments to the function
+		 * @return whether the task was started, errors while it runs are logged
+		 */
+		bool startTask(const std::string& identifier, utility::ErrorState& errorState, std::initializer_list<LuaValue> args = {});
+		
+		/**
+		 * Runs C++ work on a worker thread of the LuaService and returns a future that a task awaits with await(future).
+		 * Return the future from a bound function, the work shouldn't access the Lua state. Without a service the work runs immediately.
+		 * @param work the work, returns the function that pushes its results, see LuaFuture::makeResults()
+		 * @return the future of the results
+		 */
+		std::shared_ptr<LuaFuture> runAsync(LuaFuture::Work work);
+		
+		/**
+		 * Continues the tasks that are due. The LuaService does this every frame, after making the queued calls.
+		 * The execution budget applies to all tasks of an update together.
+		 * @param deltaTime time since the previous update in seconds
+		 */
+		void updateTasks(double deltaTime);
+		
+		/**
+		 * Continues the tasks that wait for a signal with waitSignal(name), at the next update of the tasks.
+		 * @param name name of the signal
+		 */
+		void emitSignal(const std::string& name);
+		
+		/**
+		 * @return the scheduler of the tasks of this script
+		 */
+		const LuaScheduler& getScheduler() const { return mScheduler; }
+		
+		/**
+		 * Connects a signal to a Lua function. The connection is owned by the script and disconnects when the script is destroyed.
+		 * See ELuaSignalPolicy for when the function is called and LuaSignalConnection for the arguments the signal may have.
+		 * @param signal the signal
+		 * @param handler name of the Lua function
+		 * @param policy when the function is called
+		 * @return the connection
+		 */
+		template <typename... Args>
+		LuaSignalConnection& connectSignal(Signal<Args...>& signal, const std::string& handler, ELuaSignalPolicy policy = ELuaSignalPolicy::Queued);
+		
+		/**
+		 * Disconnects a signal that was connected with connectSignal(), the emissions that were not delivered are dropped.
+		 * @param connection the connection, destroyed by this call
+		 */
+		void disconnectSignal(LuaSignalConnection& connection);
+		
+		/**
+		 * Disconnects all signals that were connected with connectSignal().
+		 */
+		void disconnectSignals();
+		
+		/**
+		 * Calls the handlers of the signals connected with the Latest and Batched policies, with the emissions since the previous call.
+		 * Called by the LuaService every frame, after the queued calls. Only from the thread that owns the script.
+		 */
+		void deliverSignals();
+		
+		/**
+		 * Sets an input of the update. Inputs are copied into the inputs table when the update starts, so the update reads a snapshot.
+		 * An event-driven script is updated again when a triggering input changes. Main thread only.
+		 * @param name the key in the inputs table
+		 * @param value the value
+		 */
+		void setInput(const std::string& name, const LuaValue& value);
+		
+		/**
+		 * Makes an event-driven script call its update function at the next update, for changes the script reads outside its inputs, like bound C++ variables.
+		 * Main thread only.
+		 */
+		void invalidate() { mDirty = true; }
+		
+		/**
+		 * @return whether the LuaService calls the update function of the script, because it is asynchronous or event-driven
+		 */
+		bool hasUpdate() const { return mAsynchronous || mEventDriven; }
+		
+		/**
+		 * Returns an output of the last finished asynchronous update: the outputs table is copied into a back buffer by the worker thread,
+		 * which becomes the front buffer when the update is finished at the start of the next frame. Main thread only.
+		 * @param name the key in the outputs table
+		 * @return the value, nil when the update didn't write it
+		 */
+		LuaValue getOutput(const std::string& name) const;
+		
+		/**
+		 * Starts the update: writes the inputs into the inputs table and calls the update function, on a worker thread of the LuaService when the script is asynchronous.
+		 * Called by the LuaService after the application update. Without a service the update runs on the calling thread.
+		 * An event-driven script that didn't change since its last update isn't called, the time is added to the delta time of its next update.
+		 * @param deltaTime time since the previous update in seconds
+		 */
+		void startUpdate(double deltaTime);
+		
+		/**
+		 * Waits for the update and makes its outputs available through getOutput(). Called by the LuaService at the start of the frame.
+		 */
+		void finishUpdate();
+		
+		/**
+		 * Waits until the running asynchronous update or background initialisation, if any, is done. Returns immediately when called from within the update.
+		 * Runs the script when it was created and compiled on a worker thread, so mValid is only meaningful after this has been called.
+		 */
+		void waitForUpdate();
+		
+		/**
+		 * Processes a block of samples on the real-time thread: makes the calls queued with enqueueCall() and calls the process function with the input buffers, the output buffers and the number of frames.
+		 * The buffers are LuaBufferViews of the channels, the samples are not copied. Doesn't allocate outside the arena, block or log.
+		 * The execution budget applies to the process function. Errors are counted and the first one is kept until takeRealTimeError() is called.
+		 * A block that starts while another thread holds the state, to collect garbage or to load the script, is skipped.
+		 * @param inputs 'inputChannelCount' read only channels of 'frameCount' samples
+		 * @param inputChannelCount number of input channels, at most 'MaxChannels' are passed
+		 * @param outputs 'outputChannelCount' channels of 'frameCount' samples the script writes
+		 * @param outputChannelCount number of output channels, at most 'MaxChannels' are passed
+		 * @param frameCount number of samples per channel
+		 * @return whether the process function was called and succeeded
+		 */
+		bool processBlock(const float* const* inputs, int inputChannelCount, float* const* outputs, int outputChannelCount, int frameCount);
+		
+		/**
+		 * Performs a garbage collection step of a real-time script, from a thread other than the real-time thread, at a moment the real-time thread is idle.
+		 * Waits until the block that is being processed is done and holds the state during the step, so keep steps small.
+		 * For scripts that are not real-time this is the same as stepGarbageCollector().
+		 * @param kilobytes size of the step, 0 for a single basic step
+		 * @return whether the step finished a collection cycle
+		 */
+		bool collectGarbage(int kilobytes = 0);
+		
+		/**
+		 * Takes the first error of the real-time thread since the previous call, if any. Called by the LuaService every frame, which logs it.
+		 * @param outError the error
+		 * @return whether there was an error
+		 */
+		bool takeRealTimeError(std::string& outError);
+		
+		/**
+		 * @return number of errors on the real-time thread
+		 */
+		uint64 getRealTimeErrorCount() const { return mRealTimeErrorCount.load(std::memory_order_relaxed); }
+		
+		/**
+		 * @return number of blocks that were skipped because another thread held the state
+		 */
+		uint64 getSkippedBlockCount() const { return mSkippedBlocks.load(std::memory_order_relaxed); }
+		
+		/**
+		 * @return the arena a real-time script allocates from, not allocated for other scripts
+		 */
+		const LuaArena& getArena() const { return mArena; }
+		
+		/**
+		 * Sets the execution budget of a single call or batch. Loading the script is not limited.
+		 * @param instructions maximum number of Lua VM instructions, 0 for no limit
+		 * @param milliseconds maximum duration, 0 for no limit
+		 */
+		void setBudget(int instructions, float milliseconds);
+		
 		/**
 		 * Return the Lua namespace to which custom C++ types and functions can be added.
 		 * @return the Lua namespace
 		 */
-		luabridge::Namespace getNamespace() { return luabridge::getGlobalNamespace(L); }
+		luabridge::Namespace getNamespace() { waitForUpdate(); return luabridge::getGlobalNamespace(L); }
+		
+		/**
+		 * Exposes a block of memory to the script without copying it, as the global 'identifier': a table with the fields 'data' (light userdata) and 'size' (in bytes).
+		 * On LuaJIT the script can read and write the memory directly through the FFI, for example with ffi.cast("float*", buffer.data).
+		 * The memory has to stay valid for as long as the script can access it.
+		 * @param identifier the name of the global in Lua
+		 * @param data the memory to expose
+		 * @param size size of the memory in bytes
+		 */
+		void setBuffer(const std::string& identifier, void* data, size_t size);
+		
+		/**
+		 * Exposes a transform to the script as the global 'identifier', a LuaTransform handle that reads and writes the component directly.
+		 * The handle stays valid when the script is loaded again, but not when a hot reload replaces the script: the new script needs the handle again.
+		 * The component has to outlive the state.
+		 * Handles are main-thread-only: the component is written without synchronisation, so asynchronous and real-time scripts are refused.
+		 * @param identifier the name of the global in Lua
+		 * @param transform the component
+		 * @param errorState contains the error when the script doesn't run on the main thread
+		 * @return whether the transform was exposed
+		 */
+		bool setTransform(const std::string& identifier, TransformComponentInstance& transform, utility::ErrorState& errorState);
+		
+		/**
+		 * Exposes transforms to the script as the global 'identifier', a LuaTransformList that reads and writes all of them in a single call.
+		 * The list stays valid when the script is loaded again. The components have to outlive the state.
+		 * Main-thread-only, like setTransform().
+		 * @param identifier the name of the global in Lua
+		 * @param transforms the components
+		 * @param errorState contains the error when the script doesn't run on the main thread
+		 * @return whether the transforms were exposed
+		 */
+		bool setTransforms(const std::string& identifier, const std::vector<TransformComponentInstance*>& transforms, utility::ErrorState& errorState);
+		
+		/**
+		 * Exposes a float uniform to the script as the global 'identifier', a LuaUniform handle that sets the uniform without looking it up.
+		 * The handle stays valid when the script is loaded again. The uniform has to outlive the state.
+		 * Main-thread-only, like setTransform(): the uniform is read by the main thread when it renders.
+		 * @param identifier the name of the global in Lua
+		 * @param uniform the uniform
+		 * @param errorState contains the error when the script doesn't run on the main thread
+		 * @return whether the uniform was exposed
+		 */
+		bool setUniform(const std::string& identifier, UniformFloatInstance& uniform, utility::ErrorState& errorState);
+		
+		/**
+		 * Exposes a vec3 uniform to the script as the global 'identifier', a LuaUniform handle that sets the uniform without looking it up.
+		 * The handle stays valid when the script is loaded again. The uniform has to outlive the state.
+		 * Main-thread-only, like setTransform(): the uniform is read by the main thread when it renders.
+		 * @param identifier the name of the global in Lua
+		 * @param uniform the uniform
+		 * @param errorState contains the error when the script doesn't run on the main thread
+		 * @return whether the uniform was exposed
+		 */
+		bool setUniform(const std::string& identifier, UniformVec3Instance& uniform, utility::ErrorState& errorState);
+		
+		/**
+		 * Exposes float and vec3 members of a uniform struct to the script as the global 'identifier', a LuaUniformStruct that sets all of them from a single array.
+		 * The members are looked up once, here. The handle stays valid when the script is loaded again. The uniforms have to outlive the state.
+		 * Main-thread-only, like setTransform().
+		 * @param identifier the name of the global in Lua
+		 * @param uniformStruct the uniform struct, a uniform buffer object of a material
+		 * @param members names of the members, in the order of their values in the array
+		 * @param errorState contains the error when a member doesn't exist or is not a float or a vec3, or when the script doesn't run on the main thread
+		 * @return whether the members were exposed
+		 */
+		bool setUniformStruct(const std::string& identifier, UniformStructInstance& uniformStruct, const std::vector<std::string>& members, utility::ErrorState& errorState);
+		
+		/**
+		 * Calls a Lua function with an array of input events, see LuaInputRouter. The events are passed through a view that is created once and
+		 * reused by every call, so the events are not copied and the call doesn't allocate. The view is only valid during the call.
+		 * @param events array of 'count' events
+		 * @param count number of events
+		 * @param handler name of the Lua function
+		 * @param errorState contains the error if calling the function fails
+		 * @return whether it succeeded to call the function
+		 */
+		bool deliverInput(const LuaInputEvent* events, int count, const std::string& handler, utility::ErrorState& errorState);
+		
+		/**
+		 * Starts the sampling profiler. The call stack is sampled every 'sampleInterval' Lua VM instructions.
+		 * The profiler has no overhead while it is stopped.
+		 * @param sampleInterval number of Lua VM instructions between samples
+		 */
+		void startProfiling(int sampleInterval = 1000);
+		
+		/**
+		 * Stops the sampling profiler, the collected samples are kept.
+		 */
+		void stopProfiling();
+		
+		/**
+		 * @return the sampling profiler of this script, to query and write the collected samples
+		 */
+		LuaProfiler& getProfiler() { return mProfiler; }
+		
+		/**
+		 * Enables or disables recording the latency of every call() and callVoid() per function.
+		 * @param enabled whether to record call latencies
+		 */
+		void setCallStatsEnabled(bool enabled) { mCallStats.setEnabled(enabled); }
+		
+		/**
+		 * @return the latency histograms of the calls into this script
+		 */
+		LuaCallStats& getCallStats() { return mCallStats; }
+		
+		/**
+		 * Starts recording trace events of calls into Lua, calls from Lua into C functions, compiling, loading and garbage collection steps.
+		 * Events are kept in a ring buffer that is allocated here, recording doesn't allocate.
+		 * @param capacity maximum number of events kept
+		 */
+		void startTracing(int capacity = 65536);
+		
+		/**
+		 * Stops recording trace events, the recorded events are kept.
+		 */
+		void stopTracing();
+		
+		/**
+		 * @return the tracer of this script, to write the recorded events with LuaTracer::writeChromeTrace()
+		 */
+		LuaTracer& getTracer() { return mTracer; }
+		
+		/**
+		 * Starts attributing allocations to the Lua source line that made them.
+		 * A sampled allocation arms a count hook on the running thread that resolves it before the next instruction and is removed again,
+		 * so the script slows down with the number of samples: use a larger interval for scripts that allocate a lot.
+		 * @param sampleInterval sample every Nth allocation, 1 to sample all of them
+		 */
+		void startMemoryProfiling(int sampleInterval = 1);
+		
+		/**
+		 * Stops sampling allocations, the collected statistics are kept.
+		 */
+		void stopMemoryProfiling();
+		
+		/**
+		 * @return the allocation site profiler of this script
+		 */
+		LuaMemoryProfiler& getMemoryProfiler() { return mMemoryProfiler; }
+		
+		/**
+		 * @return number of bytes currently allocated by the Lua state
+		 */
+		size_t getAllocatedBytes() const { return mAllocatedBytes; }
+		
+		/**
+		 * Performs an incremental garbage collection step, which shows up in the trace.
+		 * @param kilobytes size of the step, 0 for a single basic step
+		 * @return whether the step finished a collection cycle
+		 */
+		bool stepGarbageCollector(int kilobytes = 0);
+		
+		/**
+		 * Switches the garbage collection mode, using the parameters of the mode's properties.
+		 * @param mode the new mode, incremental is used when the Lua implementation has no generational mode
+		 */
+		void setGCMode(ELuaGCMode mode);
 		
 		bool mValid = false; ///< Indicates whether the currently loaded script is valid or has a syntax error.
 		
 	private:
-		std::string mScriptAsString;
+		friend class LuaSignalConnection;
+		friend class LuaScriptPool;
+		
+		/**
+		 * Wraps a single call into Lua, measuring it for the profiler and the call statistics when either is active.
+		 */
+		class CallScope final
+		{
+		public:
+			/**
+			 * @param function stack index of the called function, which finds its call statistics, 0 to look them up by identifier
+			 */
+			CallScope(LuaScript& script, const std::string& identifier, LuaTracer::ECategory category = LuaTracer::ECategory::Call, int function = 0);
+			CallScope(LuaScript& script, const std::string& identifier, const luabridge::LuaRef& function);
+			~CallScope();
+			
+		private:
+			/**
+			 * Pushes the function when the call is recorded by the call statistics.
+			 * @return stack index of the function, 0 when it isn't pushed
+			 */
+			static int pushFunction(LuaScript& script, const luabridge::LuaRef& function);
+			
+			LuaScript& mScript;
+			const std::string& mIdentifier;
+			LuaTracer::ECategory mCategory;
+			bool mOutermost = false;
+			bool mTimed = false;
+			bool mTraced = false;
+			bool mBudgeted = false;
+			int mStatsIndex = -1;
+			std::chrono::steady_clock::time_point mStart;
+		};
+		
+		/**
+		 * Takes the state of a real-time script over from the real-time thread between two blocks, for the lifetime of the scope.
+		 * Does nothing for scripts that are not real-time.
+		 */
+		class StateScope final
+		{
+		public:
+			StateScope(LuaScript& script);
+			~StateScope();
+			
+		private:
+			LuaScript& mScript;
+		};
+		
+		/**
+		 * Owner of the state of a real-time script.
+		 */
+		enum class EStateOwner : int
+		{
+			None,		///< Free to take
+			RealTime,	///< Processing a block
+			Other		///< Collecting garbage or loading
+		};
+		
+		/**
+		 * Fails the call when the function is quarantined for the rest of the frame.
+		 * @return whether the function may be called
+		 */
+		bool checkQuarantine(const std::string& identifier, utility::ErrorState& errorState);
+		
+		/**
+		 * Fails when handles to transforms or uniforms can't be given to the script, because it doesn't run on the main thread.
+		 * @return whether the handle may be exposed
+		 */
+		bool checkHandleThread(const std::string& identifier, utility::ErrorState& errorState) const;
+		
+		/**
+		 * Fails a call, using a distinct error when the call exceeded its budget.
+		 */
+		void failCall(const std::string& identifier, utility::ErrorState& errorState, const char* error);
+		
+		/**
+		 * Returns the index of the call statistics of a function, kept in a weak table next to the function,
+		 * so the name is only looked up on the first call. Doesn't allocate until the table holds LuaCallStats::sMaxFunctions functions.
+		 * @param function stack index of the called function
+		 * @param identifier name of the function
+		 * @return index of the histogram of the function, -1 when it isn't recorded
+		 */
+		int getCallStatsIndex(int function, const std::string& identifier);
+		
+		/**
+		 * Called from the count hook. Raises a Lua error when the running call exceeded its budget.
+		 * @param instructions number of instructions executed since the previous check
+		 */
+		void checkBudget(lua_State* L, int instructions);
+		
+		/**
+		 * @return whether an instruction or time budget is set
+		 */
+		bool hasBudget() const { return mInstructionBudget > 0 || mTimeBudget > 0.0f; }
+		
+		/**
+		 * Creates the state, compiles the script and optionally runs it. Called by init(), or on a worker thread.
+		 * Errors in the script are kept in mInitError, the script is still initialised so it can be fixed at runtime.
+		 * @param file the memory mapped script file
+		 * @param run whether to run the script
+		 * @param errorState contains the error if the state can't be created
+		 * @return whether the state was created
+		 */
+		bool createState(const MappedFile& file, bool run, utility::ErrorState& errorState);
+		
+		/**
+		 * Runs the compiled chunk, stopping the tasks of the previous run.
+		 * @param errorState contains the error if the chunk is missing or raises an error
+		 * @return whether the chunk ran
+		 */
+		bool runChunk(utility::ErrorState& errorState);
+		
+		/**
+		 * Logs the errors of an initialisation on a worker thread and runs the script if the worker didn't, on the thread that first uses it.
+		 */
+		void finishInit();
+		
+		/**
+		 * Compiles the mapped script file into a function that is kept in the registry, so load() can run it again without re-parsing.
+		 * When the script was created by the LuaService, the compiled chunk is shared with the other scripts of the service that load the same version of the file,
+		 * as long as there are other scripts that load the file.
+		 * @param file the memory mapped script file, read by the parser without an intermediate copy
+		 * @param version version of the contents of the mapped file
+		 * @param errorState contains the error if the script has a syntax error
+		 * @return whether the script compiled
+		 */
+		bool compile(const MappedFile& file, const LuaSourceVersion& version, utility::ErrorState& errorState);
+		
+		/**
+		 * Unregisters the script as a user of its file with the bytecode cache of the service.
+		 */
+		void releaseBytecode();
+		
+		/**
+		 * Looks up a global in the environment the script was loaded in.
+		 * @param identifier the name of the global in Lua
+		 * @return reference to the global, nil if it doesn't exist
+		 */
+		luabridge::LuaRef getGlobal(const std::string& identifier);
+		
+		/**
+		 * Applies the garbage collection mode and parameters to the state.
+		 */
+		void updateGarbageCollector();
+		
+		/**
+		 * Calls a Lua function with arguments that are copied by value.
+		 */
+		bool callValues(const std::string& identifier, const LuaValue* args, int count, utility::ErrorState& errorState);
+		
+		/**
+		 * Pushes a global function on the stack without allocating outside the arena. Records an error when it isn't a function.
+		 * @return whether the function was pushed
+		 */
+		bool pushRealTimeFunction(const std::string& identifier);
+		
+		/**
+		 * Calls the function below its arguments on the stack on the real-time thread, recording an error when it fails.
+		 */
+		bool callRealTime(const std::string& identifier, int argumentCount);
+		
+		/**
+		 * Counts an error of the real-time thread and keeps it when the main thread took the previous one, without allocating.
+		 */
+		void setRealTimeError(const std::string& identifier, const char* error);
+		
+		/**
+		 * Points the buffer views at the channels of the block, and updates the tables passed to the process function when the number of channels changed.
+		 */
+		void setChannels(const float* const* inputs, int inputChannelCount, float* const* outputs, int outputChannelCount, int frameCount);
+		
+		/**
+		 * Creates the buffer views and the tables of channels passed to the process function.
+		 */
+		void createBufferViews();
+		
+		/**
+		 * Runs the update function and copies the outputs table into the back buffer, on the worker thread.
+		 */
+		void runUpdate();
+		
+		/**
+		 * Installs or removes the debug hook, depending on which of the hook based tools are active.
+		 */
+		void updateHook();
+		
+		/**
+		 * Installs the combined hook of the active tools on a thread of the state.
+		 */
+		void setHook(lua_State* thread);
+		
+		/**
+		 * Called from the allocator when a sampled allocation is pending. Installs a hook on the running thread that fires before its next instruction,
+		 * where the hook resolves the sample and installs the combined hook again. Doesn't touch the stack.
+		 */
+		void armMemoryHook();
+		
+		/**
+		 * Allocator of the state, keeps track of the allocated memory and reports to the memory profiler.
+		 */
+		static void* allocate(void* userData, void* block, size_t oldSize, size_t newSize);
+		
+		/**
+		 * Debug hook installed on the state, dispatches the hook events to the active tools.
+		 */
+		static void hook(lua_State* L, lua_Debug* ar);
+		
+		/**
+		 * @return the script that owns the given state or coroutine
+		 */
+		static LuaScript* getScript(lua_State* L);
 		
 		lua_State* L = nullptr;
 		
+		int mChunkRef = LUA_NOREF; ///< Registry reference to the compiled script chunk.
+		int mEnvironmentRef = LUA_NOREF; ///< Registry reference to the environment of the last load() when 'FreshEnvironment' is set.
+		int mCallStatsIndicesRef = LUA_NOREF; ///< Registry reference to a weak table from called functions to the index of their call statistics.
+		LuaSourceVersion mSourceVersion; ///< Version of the contents of the script file when it was last compiled.
+		LuaFileStamp mSourceStamp; ///< Size and modification time of the script file when its version was last determined.
+		bool mBytecodeUser = false; ///< Whether the script is registered as a user of its file with the bytecode cache of the service.
+		bool mShareBytecode = false; ///< Set by the LuaScriptPool: the chunk is cached for the states that are created after this one.
+		
+		LuaProfiler mProfiler; ///< Samples the call stack while profiling.
+		LuaCallStats mCallStats; ///< Latency histogram per called function.
+		LuaTracer mTracer; ///< Records trace events while tracing.
+		LuaMemoryProfiler mMemoryProfiler; ///< Attributes allocations to source lines while memory profiling.
+		size_t mAllocatedBytes = 0; ///< Bytes currently allocated by the state.
+		
+		int mHookMask = 0; ///< Events the debug hook is installed for.
+		int mHookCount = 0; ///< Number of instructions between count hook events.
+		int mInstructionsUntilSample = 0; ///< Instructions left until the profiler takes the next sample.
+		int mCallDepth = 0; ///< Number of nested calls into Lua, the budget applies to the outermost one.
+		bool mBudgetActive = false; ///< Whether the running outermost call is limited by the budget.
+		int64 mInstructionsExecuted = 0; ///< Instructions executed by the running outermost call.
+		std::chrono::steady_clock::time_point mDeadline; ///< Time at which the running outermost call exceeds its time budget.
+		bool mBudgetExceeded = false; ///< Whether the running outermost call exceeded its budget.
+		std::unordered_set<std::string> mQuarantined; ///< Functions that exceeded their budget in this frame.
+		
+		LuaService* mService = nullptr; ///< Runs the asynchronous update, nullptr when the script was not created by the service.
+		std::future<void> mUpdate; ///< The running asynchronous update or background initialisation.
+		double mUpdateDeltaTime = 0.0; ///< Delta time passed to the running update.
+		bool mUpdateFinished = false; ///< Whether an update wrote the back buffer since the last finishUpdate().
+		std::string mUpdateError; ///< Error of the last update, logged on the main thread.
+		int mInputsRef = LUA_NOREF; ///< Registry reference to the inputs table of the update.
+		int mOutputsRef = LUA_NOREF; ///< Registry reference to the outputs table of the update.
+		std::unordered_map<std::string, LuaValue> mInputs; ///< Inputs for the next update.
+		bool mDirty = true; ///< Whether an event-driven script changed since its last update.
+		double mSkippedDeltaTime = 0.0; ///< Time since the last update of an event-driven script, up to the previous frame.
+		std::unordered_map<std::string, LuaValue> mOutputs[2]; ///< Double buffered outputs, written by the worker thread into the back buffer.
+		int mFrontOutputs = 0; ///< Index of the outputs buffer read by the main thread.
+		bool mInitPending = false; ///< Whether a worker thread initialises the state, finished by the next waitForUpdate().
+		std::string mInitError; ///< Error in the script during initialisation.
+		
+		LuaCallQueue mCallQueue; ///< Calls queued from other threads.
+		std::vector<std::unique_ptr<LuaSignalConnection>> mSignalConnections; ///< Signals connected to Lua functions.
+		LuaScheduler mScheduler; ///< Runs the tasks started with spawn() or startTask().
+		
+		LuaArena mArena; ///< Memory of a real-time state.
+		std::atomic<EStateOwner> mStateOwner = { EStateOwner::None }; ///< Thread that holds the state of a real-time script.
+		std::vector<LuaBufferView*> mInputViews; ///< Views of the input channels, owned by the state.
+		std::vector<LuaBufferView*> mOutputViews; ///< Views of the output channels, owned by the state.
+		int mViewsRef = LUA_NOREF; ///< Registry reference to the table that keeps all buffer views, the inputs followed by the outputs.
+		LuaInputEventView* mInputEventView = nullptr; ///< View of the events passed to deliverInput(), owned by the state.
+		int mInputEventViewRef = LUA_NOREF; ///< Registry reference to the view of the input events.
+		int mInputChannelsRef = LUA_NOREF; ///< Registry reference to the table of input channels passed to the process function.
+		int mOutputChannelsRef = LUA_NOREF; ///< Registry reference to the table of output channels passed to the process function.
+		int mInputChannelCount = 0; ///< Number of views in the table of input channels.
+		int mOutputChannelCount = 0; ///< Number of views in the table of output channels.
+		std::string mQueuedFunction; ///< Name of the queued function called on the real-time thread, reserved so assigning it doesn't allocate.
+		std::array<char, 256> mRealTimeError = {}; ///< First error on the real-time thread that the main thread didn't take yet.
+		std::atomic<bool> mRealTimeErrorPending = { false }; ///< Whether mRealTimeError holds an error, it is only written when false.
+		std::atomic<uint64> mRealTimeErrorCount = { 0 }; ///< Number of errors on the real-time thread.
+		std::atomic<uint64> mSkippedBlocks = { 0 }; ///< Number of blocks skipped because another thread held the state.
+		
 	};
 
 
@@ -128,7 +849,8 @@ namespace nap
 	template <typename T>
 	bool LuaScript::getVariable(const std::string& identifier, utility::ErrorState& errorState, T& outValue)
 	{
-		luabridge::LuaRef var = luabridge::getGlobal(L, identifier.c_str());
+		waitForUpdate();
+		luabridge::LuaRef var = getGlobal(identifier);
 		if(var.isNil())
 		{
 			errorState.fail("Error getting Lua variable \"%s\": %s", identifier.c_str(), lua_tostring(L, -1));
@@ -163,7 +885,11 @@ namespace nap
 	template <typename ReturnType, typename ...Args>
 	bool LuaScript::call(const std::string& identifier, utility::ErrorState& errorState, ReturnType& outReturnValue, Args&... args)
 	{
-		luabridge::LuaRef func = luabridge::getGlobal(L, identifier.c_str());
+		waitForUpdate();
+		if (!checkQuarantine(identifier, errorState))
+			return false;
+		
+		luabridge::LuaRef func = getGlobal(identifier);
 		
 		if (!func.isFunction())
 		{
@@ -173,6 +899,7 @@ namespace nap
 		
 		try
 		{
+			CallScope call_scope(*this, identifier, func);
 			auto result = func(args...);
 			if(result.size() == 0)
 			{
@@ -183,7 +910,7 @@ namespace nap
 		}
 		catch (std::exception const& e)
 		{
-			errorState.fail("Error calling Lua function \"%s\": %s", identifier.c_str(), e.what());
+			failCall(identifier, errorState, e.what());
 			return false;
 		}
 		
@@ -203,7 +930,11 @@ namespace nap
 	template <typename ...Args>
 	bool LuaScript::callVoid(const std::string& identifier, utility::ErrorState& errorState, Args&... args)
 	{
-		luabridge::LuaRef func = luabridge::getGlobal(L, identifier.c_str());
+		waitForUpdate();
+		if (!checkQuarantine(identifier, errorState))
+			return false;
+		
+		luabridge::LuaRef func = getGlobal(identifier);
 		
 		if (!func.isFunction())
 		{
@@ -213,15 +944,70 @@ namespace nap
 		
 		try
 		{
+			CallScope call_scope(*this, identifier, func);
 			func(args...);
 		}
 		catch (std::exception const& e)
 		{
-			errorState.fail("Error calling Lua function \"%s\": %s", identifier.c_str(), e.what());
+			failCall(identifier, errorState, e.what());
 			return false;
 		}
 		
 		return true;
 	}
 
+
+	template <typename ReturnType, typename ArgType>
+	bool LuaScript::callBatch(const std::string& identifier, utility::ErrorState& errorState, const ArgType* args, ReturnType* outReturnValues, size_t count)
+	{
+		waitForUpdate();
+		if (!checkQuarantine(identifier, errorState))
+			return false;
+		
+		luabridge::LuaRef func = getGlobal(identifier);
+		if (!func.isFunction())
+		{
+			errorState.fail("Error calling Lua function \"%s\": not a function", identifier.c_str());
+			return false;
+		}
+		
+		try
+		{
+			CallScope call_scope(*this, identifier, func);
+			for (size_t i = 0; i < count; i++)
+			{
+				auto result = func(args[i]);
+				if(result.size() == 0)
+				{
+					errorState.fail("Error calling Lua function \"%s\": Function didn't return", identifier.c_str());
+					return false;
+				}
+				outReturnValues[i] = result[0].template cast<ReturnType>().value();
+			}
+		}
+		catch (std::exception const& e)
+		{
+			failCall(identifier, errorState, e.what());
+			return false;
+		}
+		
+		return true;
+	}
+
+
+	template <typename... Args>
+	LuaSignalConnection& LuaScript::connectSignal(Signal<Args...>& signal, const std::string& handler, ELuaSignalPolicy policy)
+	{
+		mSignalConnections.emplace_back(std::make_unique<LuaSignalSlot<Args...>>(*this, signal, handler, policy));
+		return *mSignalConnections.back();
+	}
+
+
+	template <typename ReturnType, typename ArgType>
+	bool LuaScript::callBatch(const std::string& identifier, utility::ErrorState& errorState, const std::vector<ArgType>& args, std::vector<ReturnType>& outReturnValues)
+	{
+		outReturnValues.resize(args.size());
+		return callBatch(identifier, errorState, args.data(), outReturnValues.data(), args.size());
+	}
+
 }
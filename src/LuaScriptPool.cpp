@@ -0,0 +1,183 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "LuaScriptPool.h"
+#include "LuaService.h"
+
+#include <utility/stringutils.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+RTTI_BEGIN_CLASS_NO_DEFAULT_CONSTRUCTOR(nap::LuaScriptPool)
+	RTTI_CONSTRUCTOR(nap::LuaService&)
+	RTTI_PROPERTY_FILELINK("Path", &nap::LuaScriptPool::mPath, nap::rtti::EPropertyMetaData::Required, nap::rtti::EPropertyFileType::Any)
+	RTTI_PROPERTY("States", &nap::LuaScriptPool::mStateCount, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("GrainSize", &nap::LuaScriptPool::mGrainSize, nap::rtti::EPropertyMetaData::Default)
+RTTI_END_CLASS
+
+namespace nap
+{
+
+	namespace
+	{
+		/**
+		 * The items of a batch that belong to one state, claimed a chunk at a time by the state itself and by states that steal.
+		 */
+		struct Range
+		{
+			std::atomic<size_t> mNext { 0 };
+			size_t mEnd = 0;
+		};
+
+
+		/**
+		 * A batch that is processed by the states, shared with the tasks on the worker threads, which can outlive the call.
+		 */
+		struct Job
+		{
+			Job(size_t stateCount) : mRanges(stateCount), mClaimed(stateCount) { }
+
+			std::vector<Range> mRanges;
+			std::vector<std::atomic<bool>> mClaimed;	///< Whether a thread took the state, or the caller cancelled the task of the state
+			std::atomic<bool> mFailed { false };
+			size_t mGrainSize = 1;
+
+			std::mutex mMutex;
+			std::condition_variable mCondition;
+			int mFinishedTasks = 0;
+			std::string mError;
+		};
+
+
+		/**
+		 * Processes chunks of the own range of the state, then steals chunks from the ranges of the other states.
+		 */
+		template <typename ProcessFunction>
+		void work(Job& job, LuaScript& state, size_t stateIndex, const ProcessFunction& process)
+		{
+			utility::ErrorState error_state;
+			size_t range_count = job.mRanges.size();
+			for (size_t i = 0; i < range_count && !job.mFailed.load(std::memory_order_relaxed); i++)
+			{
+				Range& range = job.mRanges[(stateIndex + i) % range_count];
+				while (!job.mFailed.load(std::memory_order_relaxed))
+				{
+					size_t begin = range.mNext.fetch_add(job.mGrainSize, std::memory_order_relaxed);
+					if (begin >= range.mEnd)
+						break;
+
+					if (!process(state, begin, std::min(begin + job.mGrainSize, range.mEnd), error_state))
+					{
+						std::lock_guard<std::mutex> lock(job.mMutex);
+						if (!job.mFailed.exchange(true))
+							job.mError = error_state.toString();
+						return;
+					}
+				}
+			}
+		}
+	}
+
+
+	LuaScriptPool::LuaScriptPool(LuaService& service) :
+		mService(service)
+	{ }
+
+
+	bool LuaScriptPool::init(utility::ErrorState& errorState)
+	{
+		int state_count = mStateCount > 0 ? mStateCount : mService.getThreadPool().getThreadCount() + 1;
+		for (int i = 0; i < state_count; i++)
+		{
+			// The first state compiles the script and caches it, the others load its bytecode from the cache of the service.
+			auto state = std::make_unique<LuaScript>(mService);
+			state->mID = utility::stringFormat("%s[%d]", mID.c_str(), i);
+			state->mPath = mPath;
+			state->mShareBytecode = state_count > 1;
+			if (!state->init(errorState))
+			{
+				// The states that initialised are not destroyed by the resource manager, this pool failed.
+				onDestroy();
+				return false;
+			}
+			mStates.emplace_back(std::move(state));
+		}
+		return true;
+	}
+
+
+	void LuaScriptPool::onDestroy()
+	{
+		for (auto& state : mStates)
+			state->onDestroy();
+		mStates.clear();
+	}
+
+
+	bool LuaScriptPool::load(utility::ErrorState& errorState)
+	{
+		for (auto& state : mStates)
+			if (!state->load(errorState))
+				return false;
+		return true;
+	}
+
+
+	bool LuaScriptPool::run(size_t count, const ProcessFunction& process, utility::ErrorState& errorState)
+	{
+		if (!errorState.check(!mStates.empty(), "%s: no Lua states", mID.c_str()))
+			return false;
+
+		// Small batches are not worth waking up other threads for.
+		size_t grain_size = static_cast<size_t>(std::max(mGrainSize, 1));
+		if (mStates.size() == 1 || count <= grain_size)
+			return process(*mStates[0], 0, count, errorState);
+
+		auto job = std::make_shared<Job>(mStates.size());
+		job->mGrainSize = grain_size;
+		for (size_t i = 0; i < mStates.size(); i++)
+		{
+			job->mRanges[i].mNext = count * i / mStates.size();
+			job->mRanges[i].mEnd = count * (i + 1) / mStates.size();
+		}
+
+		// The other states run on the worker threads, the first one on this thread.
+		for (size_t i = 1; i < mStates.size(); i++)
+		{
+			LuaScript* state = mStates[i].get();
+			mService.getThreadPool().submit([job, state, i, &process]()
+			{
+				// The caller cancelled the task when it finished all work before the task started, it may have returned already.
+				if (job->mClaimed[i].exchange(true))
+					return;
+				work(*job, *state, i, process);
+
+				std::lock_guard<std::mutex> lock(job->mMutex);
+				job->mFinishedTasks++;
+				job->mCondition.notify_one();
+			});
+		}
+		job->mClaimed[0] = true;
+		work(*job, *mStates[0], 0, process);
+
+		// All items are claimed now: cancel the tasks that didn't start and wait for the ones that did.
+		int started_tasks = 0;
+		for (size_t i = 1; i < mStates.size(); i++)
+			if (job->mClaimed[i].exchange(true))
+				started_tasks++;
+
+		std::unique_lock<std::mutex> lock(job->mMutex);
+		job->mCondition.wait(lock, [&]() { return job->mFinishedTasks == started_tasks; });
+		if (job->mFailed)
+		{
+			errorState.fail(job->mError);
+			return false;
+		}
+		return true;
+	}
+
+}
@@ -0,0 +1,115 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include "LuaScript.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace nap
+{
+
+	class LuaService;
+
+	/**
+	 * Loads the same script into a number of independent Lua states, to run batched calls in parallel.
+	 * The input range of a batch is split across the states. Each state runs on its own thread, the calling thread included, and claims
+	 * small chunks of its range. A state that finished its range steals chunks from the ranges of the others.
+	 * The script is parsed once: the other states load the bytecode the first one compiled.
+	 * Only suitable for functions that don't depend on state shared between items, every state has its own globals.
+	 */
+	class NAPAPI LuaScriptPool : public Resource
+	{
+		RTTI_ENABLE(Resource)
+
+	public:
+		LuaScriptPool(LuaService& service);
+
+		std::string mPath; ///< Property: 'Path' Path to the Lua script.
+		int mStateCount = 0; ///< Property: 'States' Number of Lua states, 0 for one per worker thread of the LuaService plus one for the calling thread.
+		int mGrainSize = 64; ///< Property: 'GrainSize' Number of items a state claims at once, larger reduces contention, smaller balances uneven work better.
+
+		bool init(utility::ErrorState& errorState) override;
+
+		void onDestroy() override;
+
+		/**
+		 * Loads the script again in all states, for example after binding a new C++ type to each of them.
+		 * @param errorState contains the error if loading the script fails in one of the states
+		 * @return whether the script loaded in all states
+		 */
+		bool load(utility::ErrorState& errorState);
+
+		/**
+		 * @return number of states
+		 */
+		int getStateCount() const { return static_cast<int>(mStates.size()); }
+
+		/**
+		 * Returns one of the states, to bind C++ types and functions to it. Bindings have to be added to every state.
+		 * @param index index of the state
+		 * @return the state
+		 */
+		LuaScript& getState(int index) { return *mStates[index]; }
+
+		/**
+		 * Calls a Lua function once for every argument, spread across the states. Blocks until all calls are done.
+		 * @param identifier the name of the function in Lua
+		 * @param errorState contains the error if one of the calls fails
+		 * @param args array of 'count' arguments, one for each call
+		 * @param outReturnValues array of 'count' return values, one for each call
+		 * @param count number of calls
+		 * @return whether all calls succeeded
+		 */
+		template <typename ReturnType, typename ArgType>
+		bool callBatch(const std::string& identifier, utility::ErrorState& errorState, const ArgType* args, ReturnType* outReturnValues, size_t count);
+
+		/**
+		 * Calls a Lua function once for every argument, spread across the states. Blocks until all calls are done.
+		 * @param identifier the name of the function in Lua
+		 * @param errorState contains the error if one of the calls fails
+		 * @param args the arguments, one for each call
+		 * @param outReturnValues the return values, resized to the number of arguments
+		 * @return whether all calls succeeded
+		 */
+		template <typename ReturnType, typename ArgType>
+		bool callBatch(const std::string& identifier, utility::ErrorState& errorState, const std::vector<ArgType>& args, std::vector<ReturnType>& outReturnValues);
+
+	private:
+		/**
+		 * Processes the items [begin, end) with the given state.
+		 */
+		using ProcessFunction = std::function<bool(LuaScript& state, size_t begin, size_t end, utility::ErrorState& errorState)>;
+
+		/**
+		 * Splits 'count' items across the states and processes them until all are done.
+		 */
+		bool run(size_t count, const ProcessFunction& process, utility::ErrorState& errorState);
+
+		LuaService& mService;
+		std::vector<std::unique_ptr<LuaScript>> mStates;
+	};
+
+
+	template <typename ReturnType, typename ArgType>
+	bool LuaScriptPool::callBatch(const std::string& identifier, utility::ErrorState& errorState, const ArgType* args, ReturnType* outReturnValues, size_t count)
+	{
+		return run(count, [&](LuaScript& state, size_t begin, size_t end, utility::ErrorState& stateErrorState)
+		{
+			return state.callBatch(identifier, stateErrorState, args + begin, outReturnValues + begin, end - begin);
+		}, errorState);
+	}
+
+
+	template <typename ReturnType, typename ArgType>
+	bool LuaScriptPool::callBatch(const std::string& identifier, utility::ErrorState& errorState, const std::vector<ArgType>& args, std::vector<ReturnType>& outReturnValues)
+	{
+		outReturnValues.resize(args.size());
+		return callBatch(identifier, errorState, args.data(), outReturnValues.data(), args.size());
+	}
+
+}
@@ -0,0 +1,291 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "LuaSerialize.h"
+
+#include <nap/numeric.h>
+
+#include <cmath>
+#include <cstring>
+
+namespace nap
+{
+	namespace luaserialize
+	{
+		namespace
+		{
+			/**
+			 * Type tag that precedes every serialised value.
+			 */
+			enum class ETag : uint8
+			{
+				Nil,
+				False,
+				True,
+				Number,		///< Followed by a double
+				Integer,	///< Followed by an int64, only written by Lua 5.3 and later
+				String,		///< Followed by the uint32 length and the characters
+				Table,		///< Followed by the uint32 length of the array part, its values, key value pairs and End
+				End
+			};
+
+
+			template <typename T>
+			void put(std::vector<char>& buffer, const T& value)
+			{
+				const char* bytes = reinterpret_cast<const char*>(&value);
+				buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+			}
+
+
+			void putTag(std::vector<char>& buffer, ETag tag)
+			{
+				buffer.emplace_back(static_cast<char>(tag));
+			}
+
+
+			/**
+			 * @return whether the key at 'index' is one of the integer keys 1 to 'arrayLength', which are written as the array part
+			 */
+			bool isArrayKey(lua_State* L, int index, size_t arrayLength)
+			{
+				if (arrayLength == 0 || lua_type(L, index) != LUA_TNUMBER)
+					return false;
+				lua_Number key = lua_tonumber(L, index);
+				return key >= 1 && key <= static_cast<lua_Number>(arrayLength) && std::floor(key) == key;
+			}
+
+
+			const char* writeValue(lua_State* L, int index, std::vector<char>& buffer, int depth)
+			{
+				index = luacompat::absIndex(L, index);
+				switch (lua_type(L, index))
+				{
+				case LUA_TNIL:
+					putTag(buffer, ETag::Nil);
+					return nullptr;
+
+				case LUA_TBOOLEAN:
+					putTag(buffer, lua_toboolean(L, index) ? ETag::True : ETag::False);
+					return nullptr;
+
+				case LUA_TNUMBER:
+					if (luacompat::isInteger(L, index))
+					{
+						putTag(buffer, ETag::Integer);
+						put(buffer, static_cast<int64>(lua_tointeger(L, index)));
+					}
+					else
+					{
+						putTag(buffer, ETag::Number);
+						put(buffer, static_cast<double>(lua_tonumber(L, index)));
+					}
+					return nullptr;
+
+				case LUA_TSTRING:
+				{
+					size_t length = 0;
+					const char* string = lua_tolstring(L, index, &length);
+					putTag(buffer, ETag::String);
+					put(buffer, static_cast<uint32>(length));
+					buffer.insert(buffer.end(), string, string + length);
+					return nullptr;
+				}
+
+				case LUA_TTABLE:
+				{
+					if (depth >= sMaxDepth)
+						return "tables are nested too deeply or contain themselves";
+					if (!lua_checkstack(L, 3))
+						return "stack overflow";
+
+					size_t array_length = luacompat::rawLength(L, index);
+					putTag(buffer, ETag::Table);
+					put(buffer, static_cast<uint32>(array_length));
+					for (size_t i = 1; i <= array_length; i++)
+					{
+						lua_rawgeti(L, index, static_cast<int>(i));
+						const char* error = writeValue(L, -1, buffer, depth + 1);
+						lua_pop(L, 1);
+						if (error != nullptr)
+							return error;
+					}
+
+					lua_pushnil(L);
+					while (lua_next(L, index) != 0)
+					{
+						const char* error = nullptr;
+						if (!isArrayKey(L, -2, array_length))
+						{
+							error = writeValue(L, -2, buffer, depth + 1);
+							if (error == nullptr)
+								error = writeValue(L, -1, buffer, depth + 1);
+						}
+						if (error != nullptr)
+						{
+							lua_pop(L, 2);
+							return error;
+						}
+						lua_pop(L, 1);
+					}
+					putTag(buffer, ETag::End);
+					return nullptr;
+				}
+
+				default:
+					return "only nil, booleans, numbers, strings and tables can be serialised";
+				}
+			}
+
+
+			/**
+			 * Reads values from a serialised buffer, checking every read against its end.
+			 */
+			struct Reader
+			{
+				const char* mPosition = nullptr;
+				const char* mEnd = nullptr;
+
+				template <typename T>
+				bool get(T& outValue)
+				{
+					if (static_cast<size_t>(mEnd - mPosition) < sizeof(T))
+						return false;
+					std::memcpy(&outValue, mPosition, sizeof(T));
+					mPosition += sizeof(T);
+					return true;
+				}
+			};
+
+
+			bool readValue(lua_State* L, Reader& reader, int depth)
+			{
+				uint8 tag = 0;
+				if (depth > sMaxDepth || !lua_checkstack(L, 3) || !reader.get(tag))
+					return false;
+
+				switch (static_cast<ETag>(tag))
+				{
+				case ETag::Nil:
+					lua_pushnil(L);
+					return true;
+
+				case ETag::False:
+				case ETag::True:
+					lua_pushboolean(L, static_cast<ETag>(tag) == ETag::True);
+					return true;
+
+				case ETag::Number:
+				{
+					double value = 0.0;
+					if (!reader.get(value))
+						return false;
+					lua_pushnumber(L, static_cast<lua_Number>(value));
+					return true;
+				}
+
+				case ETag::Integer:
+				{
+					int64 value = 0;
+					if (!reader.get(value))
+						return false;
+					lua_pushinteger(L, static_cast<lua_Integer>(value));
+					return true;
+				}
+
+				case ETag::String:
+				{
+					uint32 length = 0;
+					if (!reader.get(length) || static_cast<size_t>(reader.mEnd - reader.mPosition) < length)
+						return false;
+					lua_pushlstring(L, reader.mPosition, length);
+					reader.mPosition += length;
+					return true;
+				}
+
+				case ETag::Table:
+				{
+					// The array part is sized up front, the values are stored without rehashing.
+					uint32 array_length = 0;
+					if (!reader.get(array_length) || static_cast<size_t>(reader.mEnd - reader.mPosition) < array_length)
+						return false;
+					lua_createtable(L, static_cast<int>(array_length), 0);
+					for (uint32 i = 1; i <= array_length; i++)
+					{
+						if (!readValue(L, reader, depth + 1))
+							return false;
+						lua_rawseti(L, -2, static_cast<int>(i));
+					}
+
+					while (true)
+					{
+						if (reader.mPosition == reader.mEnd)
+							return false;
+						if (static_cast<ETag>(*reader.mPosition) == ETag::End)
+						{
+							reader.mPosition++;
+							return true;
+						}
+						if (!readValue(L, reader, depth + 1) || !readValue(L, reader, depth + 1))
+							return false;
+						if (lua_isnil(L, -2))
+							return false;
+						lua_rawset(L, -3);
+					}
+				}
+
+				default:
+					return false;
+				}
+			}
+		}
+
+
+		const char* write(lua_State* L, int index, std::vector<char>& buffer)
+		{
+			return writeValue(L, index, buffer, 0);
+		}
+
+
+		void write(const LuaValue& value, std::vector<char>& buffer)
+		{
+			switch (value.getType())
+			{
+			case LuaValue::EType::Nil:
+				putTag(buffer, ETag::Nil);
+				break;
+			case LuaValue::EType::Boolean:
+				putTag(buffer, value.toBoolean() ? ETag::True : ETag::False);
+				break;
+			case LuaValue::EType::Number:
+				putTag(buffer, ETag::Number);
+				put(buffer, value.toNumber());
+				break;
+			case LuaValue::EType::String:
+			{
+				const char* string = value.toString();
+				auto length = static_cast<uint32>(std::strlen(string));
+				putTag(buffer, ETag::String);
+				put(buffer, length);
+				buffer.insert(buffer.end(), string, string + length);
+				break;
+			}
+			}
+		}
+
+
+		bool read(lua_State* L, const char* data, size_t size)
+		{
+			int top = lua_gettop(L);
+			Reader reader;
+			reader.mPosition = data;
+			reader.mEnd = data + size;
+			if (readValue(L, reader, 0) && reader.mPosition == reader.mEnd)
+				return true;
+
+			lua_settop(L, top);
+			return false;
+		}
+	}
+}
@@ -0,0 +1,49 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include "LuaCompat.h"
+#include "LuaValue.h"
+
+#include <utility/dllexport.h>
+
+#include <vector>
+
+namespace nap
+{
+	namespace luaserialize
+	{
+		/**
+		 * Maximum depth of nested tables, deeper tables and tables that contain themselves are not serialised.
+		 */
+		constexpr int sMaxDepth = 32;
+
+		/**
+		 * Appends the value at 'index' to the buffer in a compact binary format: nil, booleans, numbers, strings and tables of these, nested up to sMaxDepth.
+		 * The array part of a table is written in order, so it is rebuilt without rehashing. The stack is left unchanged.
+		 * @param L the Lua state
+		 * @param index stack index of the value
+		 * @param buffer the buffer to append to, appended to partially when serialising fails
+		 * @return nullptr on success, otherwise a static description of the error, which doesn't have to be freed
+		 */
+		NAPAPI const char* write(lua_State* L, int index, std::vector<char>& buffer);
+
+		/**
+		 * Appends a value from C++ to the buffer, in the format of write().
+		 * @param value the value
+		 * @param buffer the buffer to append to
+		 */
+		NAPAPI void write(const LuaValue& value, std::vector<char>& buffer);
+
+		/**
+		 * Reads a value written by write() and pushes it on the stack.
+		 * @param L the Lua state
+		 * @param data the serialised value
+		 * @param size size of the serialised value in bytes
+		 * @return whether the value was read, nothing is pushed when it is malformed
+		 */
+		NAPAPI bool read(lua_State* L, const char* data, size_t size);
+	}
+}
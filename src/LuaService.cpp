@@ -0,0 +1,133 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "LuaService.h"
+#include "LuaScript.h"
+#include "LuaScriptPool.h"
+#include "LuaChannel.h"
+
+#include <rtti/factory.h>
+
+#include <algorithm>
+#include <thread>
+
+RTTI_BEGIN_CLASS(nap::LuaServiceConfiguration)
+	RTTI_PROPERTY("WorkerThreads", &nap::LuaServiceConfiguration::mWorkerThreads, nap::rtti::EPropertyMetaData::Default)
+RTTI_END_CLASS
+
+RTTI_BEGIN_CLASS_NO_DEFAULT_CONSTRUCTOR(nap::LuaService)
+	RTTI_CONSTRUCTOR(nap::ServiceConfiguration*)
+RTTI_END_CLASS
+
+namespace nap
+{
+
+	rtti::TypeInfo LuaServiceConfiguration::getServiceType() const
+	{
+		return RTTI_OF(LuaService);
+	}
+
+
+	LuaService::LuaService(ServiceConfiguration* configuration) :
+		Service(configuration)
+	{ }
+
+
+	void LuaService::registerObjectCreators(rtti::Factory& factory)
+	{
+		factory.addObjectCreator(std::make_unique<rtti::ObjectCreator<LuaScript, LuaService>>(*this));
+		factory.addObjectCreator(std::make_unique<rtti::ObjectCreator<LuaScriptPool, LuaService>>(*this));
+		factory.addObjectCreator(std::make_unique<rtti::ObjectCreator<LuaChannel, LuaService>>(*this));
+	}
+
+
+	bool LuaService::init(utility::ErrorState& errorState)
+	{
+		int thread_count = 0;
+		auto* configuration = getConfiguration<LuaServiceConfiguration>();
+		if (configuration != nullptr)
+			thread_count = configuration->mWorkerThreads;
+		if (thread_count <= 0)
+			thread_count = std::max(static_cast<int>(std::thread::hardware_concurrency()) - 1, 1);
+
+		mThreadPool.start(thread_count);
+		return true;
+	}
+
+
+	void LuaService::resourcesLoaded()
+	{
+		for (auto* script : mScripts)
+			script->waitForUpdate();
+	}
+
+
+	void LuaService::update(double deltaTime)
+	{
+		// No script reads a channel while its batch is replaced.
+		for (auto* script : mScripts)
+			if (script->hasUpdate())
+				script->finishUpdate();
+		for (auto* channel : mChannels)
+			channel->publish();
+
+		std::string error;
+		for (auto* script : mScripts)
+		{
+			// The real-time thread makes the queued calls of a real-time script, its errors are logged here.
+			if (script->mRealTime)
+			{
+				if (script->takeRealTimeError(error))
+					Logger::warn(error);
+				continue;
+			}
+			
+			script->nextFrame();
+			script->processCalls();
+			script->deliverSignals();
+			script->updateTasks(deltaTime);
+		}
+	}
+
+
+	void LuaService::postUpdate(double deltaTime)
+	{
+		for (auto* script : mScripts)
+			if (script->hasUpdate())
+				script->startUpdate(deltaTime);
+	}
+
+
+	void LuaService::shutdown()
+	{
+		for (auto* script : mScripts)
+			script->waitForUpdate();
+		mThreadPool.stop();
+	}
+
+
+	void LuaService::registerScript(LuaScript& script)
+	{
+		mScripts.emplace_back(&script);
+	}
+
+
+	void LuaService::unregisterScript(LuaScript& script)
+	{
+		mScripts.erase(std::remove(mScripts.begin(), mScripts.end(), &script), mScripts.end());
+	}
+
+
+	void LuaService::registerChannel(LuaChannel& channel)
+	{
+		mChannels.emplace_back(&channel);
+	}
+
+
+	void LuaService::unregisterChannel(LuaChannel& channel)
+	{
+		mChannels.erase(std::remove(mChannels.begin(), mChannels.end(), &channel), mChannels.end());
+	}
+
+}
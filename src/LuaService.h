@@ -0,0 +1,95 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include "LuaThreadPool.h"
+#include "LuaBytecodeCache.h"
+
+#include <nap/service.h>
+
+#include <vector>
+
+namespace nap
+{
+
+	class LuaScript;
+	class LuaChannel;
+	class LuaService;
+
+	/**
+	 * Configuration of the LuaService.
+	 */
+	class NAPAPI LuaServiceConfiguration : public ServiceConfiguration
+	{
+		RTTI_ENABLE(ServiceConfiguration)
+
+	public:
+		int mWorkerThreads = 0; ///< Property: 'WorkerThreads' Number of threads that run asynchronous script work, 0 for one less than the number of cores.
+
+		rtti::TypeInfo getServiceType() const override;
+	};
+
+
+	/**
+	 * Runs the per-frame update of asynchronous scripts on worker threads.
+	 * The update of an asynchronous script is started after the application update, so it runs in parallel with rendering,
+	 * and is finished at the start of the next frame, before the application update reads its outputs.
+	 */
+	class NAPAPI LuaService : public Service
+	{
+		RTTI_ENABLE(Service)
+
+	public:
+		LuaService(ServiceConfiguration* configuration);
+
+		/**
+		 * @return the threads that run asynchronous script work
+		 */
+		LuaThreadPool& getThreadPool() { return mThreadPool; }
+		
+		/**
+		 * @return the precompiled chunks shared by the scripts created by this service
+		 */
+		LuaBytecodeCache& getBytecodeCache() { return mBytecodeCache; }
+
+	protected:
+		void registerObjectCreators(rtti::Factory& factory) override;
+
+		bool init(utility::ErrorState& errorState) override;
+
+		/**
+		 * Finishes the initialisation of the scripts that were created on a worker thread.
+		 */
+		void resourcesLoaded() override;
+
+		/**
+		 * Finishes the updates of the asynchronous scripts that were started in the previous frame and publishes the messages sent on channels,
+		 * then makes the calls that other threads queued on the scripts, delivers the signals connected to them and updates their tasks.
+		 */
+		void update(double deltaTime) override;
+
+		/**
+		 * Starts the updates of the asynchronous scripts and of the event-driven scripts that changed, after the application update.
+		 */
+		void postUpdate(double deltaTime) override;
+
+		void shutdown() override;
+
+	private:
+		friend class LuaScript;
+		friend class LuaChannel;
+
+		void registerScript(LuaScript& script);
+		void unregisterScript(LuaScript& script);
+		void registerChannel(LuaChannel& channel);
+		void unregisterChannel(LuaChannel& channel);
+
+		LuaThreadPool mThreadPool;
+		LuaBytecodeCache mBytecodeCache;
+		std::vector<LuaScript*> mScripts; ///< Initialised scripts created by this service.
+		std::vector<LuaChannel*> mChannels; ///< Initialised channels created by this service.
+	};
+
+}
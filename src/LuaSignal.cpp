@@ -0,0 +1,116 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "LuaSignal.h"
+#include "LuaScript.h"
+
+#include <nap/logger.h>
+
+namespace nap
+{
+
+	LuaSignalConnection::LuaSignalConnection(LuaScript& script, const std::string& handler, ELuaSignalPolicy policy, int argumentCount) :
+		mScript(script), mHandler(handler), mPolicy(policy), mArgumentCount(argumentCount)
+	{ }
+
+
+	LuaSignalConnection::~LuaSignalConnection()
+	{
+		if (mBatchRef != LUA_NOREF && mScript.L != nullptr)
+			luaL_unref(mScript.L, LUA_REGISTRYINDEX, mBatchRef);
+	}
+
+
+	void LuaSignalConnection::receive(const LuaValue* arguments)
+	{
+		switch (mPolicy)
+		{
+		case ELuaSignalPolicy::Immediate:
+		{
+			mScript.waitForUpdate();
+			utility::ErrorState error_state;
+			if (!mScript.callValues(mHandler, arguments, mArgumentCount, error_state))
+				Logger::warn(error_state.toString());
+			break;
+		}
+
+		case ELuaSignalPolicy::Queued:
+			mScript.mCallQueue.push(mHandler.c_str(), arguments, mArgumentCount);
+			break;
+
+		case ELuaSignalPolicy::Latest:
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mPending.assign(arguments, arguments + mArgumentCount);
+			mPendingCount = 1;
+			break;
+		}
+
+		case ELuaSignalPolicy::Batched:
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mPending.insert(mPending.end(), arguments, arguments + mArgumentCount);
+			mPendingCount++;
+			break;
+		}
+		}
+	}
+
+
+	void LuaSignalConnection::deliver()
+	{
+		int count = 0;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (mPendingCount == 0)
+				return;
+			std::swap(mPending, mDelivering);
+			count = mPendingCount;
+			mPending.clear();
+			mPendingCount = 0;
+		}
+
+		utility::ErrorState error_state;
+		if (mPolicy == ELuaSignalPolicy::Latest)
+		{
+			if (!mScript.callValues(mHandler, mDelivering.data(), mArgumentCount, error_state))
+				Logger::warn(error_state.toString());
+			return;
+		}
+
+		// Fill the array of the previous frame, clearing the values it doesn't overwrite.
+		lua_State* L = mScript.L;
+		if (mBatchRef == LUA_NOREF)
+		{
+			lua_newtable(L);
+			mBatchRef = luaL_ref(L, LUA_REGISTRYINDEX);
+		}
+		lua_rawgeti(L, LUA_REGISTRYINDEX, mBatchRef);
+		int length = static_cast<int>(mDelivering.size());
+		for (int i = 0; i < length; i++)
+		{
+			mDelivering[i].push(L);
+			lua_rawseti(L, -2, i + 1);
+		}
+		for (int i = length; i < mBatchLength; i++)
+		{
+			lua_pushnil(L);
+			lua_rawseti(L, -2, i + 1);
+		}
+		mBatchLength = length;
+
+		luabridge::LuaRef batch = luabridge::LuaRef::fromStack(L);
+		if (!mScript.callVoid(mHandler, error_state, batch, count))
+			Logger::warn(error_state.toString());
+	}
+
+
+	void LuaSignalConnection::clear()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mPending.clear();
+		mPendingCount = 0;
+	}
+
+}
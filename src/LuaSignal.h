@@ -0,0 +1,113 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include "LuaCompat.h"
+#include "LuaValue.h"
+
+#include <nap/signalslot.h>
+#include <utility/dllexport.h>
+
+#include <array>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace nap
+{
+
+	class LuaScript;
+
+	/**
+	 * When a Lua handler connected to a signal is called.
+	 */
+	enum class ELuaSignalPolicy : int
+	{
+		Immediate,	///< Synchronously, for every emission. The signal has to be emitted on the thread that owns the script.
+		Queued,		///< For every emission, at the next processCalls(), through the queue of enqueueCall(). At most LuaCallQueue::sMaxArguments arguments.
+		Latest,		///< Once per frame with the arguments of the last emission, the earlier emissions of the frame are dropped.
+		Batched		///< Once per frame with a flat array of the arguments of all emissions of the frame and the number of emissions.
+	};
+
+
+	/**
+	 * Connects a signal to a Lua function, created with LuaScript::connectSignal(). The arguments of the signal are converted to LuaValues when it is emitted,
+	 * so they have to be numbers, booleans or strings. The signal may be emitted from any thread unless the policy is Immediate.
+	 * The handler is looked up by name when it is called, so it follows the script when it is loaded again. Emissions that were not delivered are dropped on load().
+	 */
+	class NAPAPI LuaSignalConnection
+	{
+	public:
+		LuaSignalConnection(LuaScript& script, const std::string& handler, ELuaSignalPolicy policy, int argumentCount);
+		virtual ~LuaSignalConnection();
+
+		LuaSignalConnection(const LuaSignalConnection&) = delete;
+		LuaSignalConnection& operator=(const LuaSignalConnection&) = delete;
+
+		/**
+		 * @return the name of the Lua function that handles the signal
+		 */
+		const std::string& getHandler() const { return mHandler; }
+
+		/**
+		 * @return when the handler is called
+		 */
+		ELuaSignalPolicy getPolicy() const { return mPolicy; }
+
+		/**
+		 * Calls the handler with the emissions of the frame, when the policy is Latest or Batched. Called by the LuaService every frame, only from the thread that owns the script.
+		 */
+		void deliver();
+
+		/**
+		 * Drops the emissions that were not delivered yet.
+		 */
+		void clear();
+
+	protected:
+		/**
+		 * Handles an emission of the signal.
+		 * @param arguments the arguments of the emission, as many as the signal has
+		 */
+		void receive(const LuaValue* arguments);
+
+	private:
+		LuaScript& mScript;
+		std::string mHandler;
+		ELuaSignalPolicy mPolicy;
+		int mArgumentCount;
+
+		std::mutex mMutex;
+		std::vector<LuaValue> mPending;		///< Arguments of the emissions that were not delivered yet
+		int mPendingCount = 0;				///< Number of emissions in mPending
+		std::vector<LuaValue> mDelivering;	///< Arguments that are being delivered, swapped with mPending so neither is reallocated
+		int mBatchRef = LUA_NOREF;				///< Registry reference to the array passed to a batched handler, reused every frame
+		int mBatchLength = 0;				///< Number of values in that array
+	};
+
+
+	/**
+	 * Connection of a signal with the arguments 'Args' to a Lua function. The slot disconnects from the signal when the connection is destroyed.
+	 */
+	template <typename... Args>
+	class LuaSignalSlot final : public LuaSignalConnection
+	{
+	public:
+		LuaSignalSlot(LuaScript& script, Signal<Args...>& signal, const std::string& handler, ELuaSignalPolicy policy) :
+			LuaSignalConnection(script, handler, policy, static_cast<int>(sizeof...(Args))),
+			mSlot([this](Args... args)
+			{
+				std::array<LuaValue, sizeof...(Args)> arguments = { LuaValue(args)... };
+				receive(arguments.data());
+			})
+		{
+			signal.connect(mSlot);
+		}
+
+	private:
+		Slot<Args...> mSlot;
+	};
+
+}
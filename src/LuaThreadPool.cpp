@@ -0,0 +1,78 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "LuaThreadPool.h"
+
+#include <algorithm>
+
+namespace nap
+{
+
+	LuaThreadPool::~LuaThreadPool()
+	{
+		stop();
+	}
+
+
+	void LuaThreadPool::start(int threadCount)
+	{
+		stop();
+		mStopping = false;
+		for (int i = 0; i < std::max(threadCount, 1); i++)
+			mThreads.emplace_back(&LuaThreadPool::run, this);
+	}
+
+
+	void LuaThreadPool::stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStopping = true;
+		}
+		mCondition.notify_all();
+		for (auto& thread : mThreads)
+			thread.join();
+		mThreads.clear();
+	}
+
+
+	std::future<void> LuaThreadPool::submit(Task task)
+	{
+		std::packaged_task<void()> packaged_task(std::move(task));
+		std::future<void> future = packaged_task.get_future();
+
+		// Without threads the task runs inline, so work submitted during shutdown still completes.
+		if (mThreads.empty())
+		{
+			packaged_task();
+			return future;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mTasks.emplace_back(std::move(packaged_task));
+		}
+		mCondition.notify_one();
+		return future;
+	}
+
+
+	void LuaThreadPool::run()
+	{
+		while (true)
+		{
+			std::packaged_task<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+				mCondition.wait(lock, [this]() { return mStopping || !mTasks.empty(); });
+				if (mTasks.empty())
+					return;
+				task = std::move(mTasks.front());
+				mTasks.pop_front();
+			}
+			task();
+		}
+	}
+
+}
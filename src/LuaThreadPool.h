@@ -0,0 +1,68 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <utility/dllexport.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nap
+{
+
+	/**
+	 * Fixed number of worker threads that execute tasks in the order they are submitted.
+	 * Owned by the LuaService, which runs the asynchronous work of all scripts on it.
+	 */
+	class NAPAPI LuaThreadPool final
+	{
+	public:
+		using Task = std::function<void()>;
+
+		LuaThreadPool() = default;
+		~LuaThreadPool();
+
+		LuaThreadPool(const LuaThreadPool&) = delete;
+		LuaThreadPool& operator=(const LuaThreadPool&) = delete;
+
+		/**
+		 * Starts the worker threads.
+		 * @param threadCount number of threads, at least one
+		 */
+		void start(int threadCount);
+
+		/**
+		 * Finishes the tasks that are already submitted and joins the worker threads.
+		 */
+		void stop();
+
+		/**
+		 * @return number of worker threads, 0 when not started
+		 */
+		int getThreadCount() const { return static_cast<int>(mThreads.size()); }
+
+		/**
+		 * Queues a task.
+		 * @param task the task to execute on one of the worker threads
+		 * @return future that is ready when the task finished, and rethrows what the task threw
+		 */
+		std::future<void> submit(Task task);
+
+	private:
+		void run();
+
+		std::vector<std::thread> mThreads;
+		std::deque<std::packaged_task<void()>> mTasks;
+		std::mutex mMutex;
+		std::condition_variable mCondition;
+		bool mStopping = false;
+	};
+
+}
@@ -0,0 +1,167 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "LuaTracer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+namespace nap
+{
+
+	static const char* getCategoryName(LuaTracer::ECategory category)
+	{
+		switch (category)
+		{
+			case LuaTracer::ECategory::Call:	return "lua.call";
+			case LuaTracer::ECategory::Native:	return "lua.native";
+			case LuaTracer::ECategory::Compile:	return "lua.compile";
+			case LuaTracer::ECategory::Load:	return "lua.load";
+			case LuaTracer::ECategory::GC:		return "lua.gc";
+		}
+		return "lua";
+	}
+
+
+	static uint32 getThreadID()
+	{
+		thread_local uint32 id = static_cast<uint32>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+		return id;
+	}
+
+
+	static void writeEscaped(std::ostream& stream, const char* text)
+	{
+		for (const char* c = text; *c != '\0'; c++)
+		{
+			if (*c == '"' || *c == '\\')
+				stream << '\\' << *c;
+			else if (static_cast<unsigned char>(*c) < 0x20)
+				stream << ' ';
+			else
+				stream << *c;
+		}
+	}
+
+
+	void LuaTracer::start(int capacity)
+	{
+		capacity = std::max(capacity, 1);
+		if (static_cast<int>(mEvents.size()) != capacity)
+		{
+			mEvents.assign(capacity, Event());
+			mWriteIndex = 0;
+		}
+		mRunning = true;
+	}
+
+
+	void LuaTracer::stop()
+	{
+		mRunning = false;
+	}
+
+
+	void LuaTracer::clear()
+	{
+		mWriteIndex = 0;
+		mOpenNativeEvents = 0;
+	}
+
+
+	void LuaTracer::begin(ECategory category, const char* name)
+	{
+		record(category, 'B', name);
+	}
+
+
+	void LuaTracer::end(ECategory category)
+	{
+		record(category, 'E', "");
+	}
+
+
+	void LuaTracer::onHook(lua_State* L, lua_Debug* ar)
+	{
+		if (!lua_getinfo(L, "S", ar) || ar->what[0] != 'C')
+			return;
+
+		if (ar->event == LUA_HOOKCALL)
+		{
+			lua_getinfo(L, "n", ar);
+			begin(ECategory::Native, ar->name != nullptr ? ar->name : "?");
+			mOpenNativeEvents++;
+		}
+		else if (ar->event == LUA_HOOKRET && mOpenNativeEvents > 0)
+		{
+			end(ECategory::Native);
+			mOpenNativeEvents--;
+		}
+	}
+
+
+	void LuaTracer::closeNativeEvents()
+	{
+		for (; mOpenNativeEvents > 0; mOpenNativeEvents--)
+			end(ECategory::Native);
+	}
+
+
+	int LuaTracer::getEventCount() const
+	{
+		return static_cast<int>(std::min<uint64>(mWriteIndex, mEvents.size()));
+	}
+
+
+	void LuaTracer::record(ECategory category, char phase, const char* name)
+	{
+		if (mEvents.empty())
+			return;
+		
+		Event& event = mEvents[mWriteIndex % mEvents.size()];
+		event.mTimestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		event.mThread = getThreadID();
+		event.mCategory = category;
+		event.mPhase = phase;
+		std::strncpy(event.mName, name, sMaxNameLength);
+		mWriteIndex++;
+	}
+
+
+	bool LuaTracer::writeChromeTrace(const std::string& path, const std::vector<std::pair<const LuaTracer*, std::string>>& tracers, utility::ErrorState& errorState)
+	{
+		std::ofstream file(path, std::ios::binary);
+		if (!errorState.check(file.is_open(), "Unable to open file for writing: %s", path.c_str()))
+			return false;
+
+		file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+		bool first = true;
+		for (const auto& [tracer, script] : tracers)
+		{
+			// Oldest event first, the ring buffer may have wrapped around.
+			int count = tracer->getEventCount();
+			uint64 start = tracer->mWriteIndex - count;
+			for (int i = 0; i < count; i++)
+			{
+				const Event& event = tracer->mEvents[(start + i) % tracer->mEvents.size()];
+				file << (first ? "\n" : ",\n");
+				first = false;
+
+				file << "{\"ph\":\"" << event.mPhase << "\",\"cat\":\"" << getCategoryName(event.mCategory) << "\",\"name\":\"";
+				writeEscaped(file, event.mPhase == 'B' ? event.mName : "");
+				file << "\",\"ts\":" << event.mTimestamp / 1000 << '.' << (event.mTimestamp % 1000) / 100;
+				file << ",\"pid\":1,\"tid\":" << event.mThread << ",\"args\":{\"script\":\"";
+				writeEscaped(file, script.c_str());
+				file << "\"}}";
+			}
+		}
+		file << "\n]}\n";
+		return errorState.check(file.good(), "Unable to write trace to file: %s", path.c_str());
+	}
+
+}
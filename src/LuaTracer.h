@@ -0,0 +1,123 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <utility/dllexport.h>
+#include <utility/errorstate.h>
+#include <nap/numeric.h>
+
+extern "C" {
+	#include <lua.h>
+}
+
+#include <string>
+#include <vector>
+
+namespace nap
+{
+
+	/**
+	 * Records begin and end events of the work done by a single Lua state into a preallocated ring buffer.
+	 * When the buffer is full the oldest events are overwritten. Recording an event doesn't allocate.
+	 * The events can be written in the Chrome trace_event JSON format, which opens in Perfetto and chrome://tracing.
+	 * Timestamps come from the steady clock, so the traces of multiple scripts can be written to the same timeline.
+	 */
+	class NAPAPI LuaTracer final
+	{
+	public:
+		/**
+		 * Kind of work an event describes.
+		 */
+		enum class ECategory : uint8
+		{
+			Call,		///< C++ calling a Lua function
+			Native,		///< Lua calling a C function, which includes bound C++ functions
+			Compile,	///< Parsing the script file, on initialisation and when it changed on disk
+			Load,		///< Running the script chunk
+			GC			///< Garbage collection step
+		};
+
+		/**
+		 * Starts recording, allocating the ring buffer when its capacity changed.
+		 * @param capacity maximum number of events kept
+		 */
+		void start(int capacity);
+
+		/**
+		 * Stops recording, the recorded events are kept.
+		 */
+		void stop();
+
+		/**
+		 * @return whether events are recorded
+		 */
+		bool isRunning() const { return mRunning; }
+
+		/**
+		 * Discards all recorded events.
+		 */
+		void clear();
+
+		/**
+		 * Records the start of a piece of work.
+		 * @param category kind of work
+		 * @param name name of the work, truncated when it doesn't fit an event
+		 */
+		void begin(ECategory category, const char* name);
+
+		/**
+		 * Records the end of the last piece of work of the given category.
+		 * @param category kind of work
+		 */
+		void end(ECategory category);
+
+		/**
+		 * Handles a call or return hook event, recording calls from Lua into C functions.
+		 * @param L the state, or coroutine, that is executing
+		 * @param ar the hook event
+		 */
+		void onHook(lua_State* L, lua_Debug* ar);
+
+		/**
+		 * Ends the C function events that are still open, for example because the C function raised an error.
+		 * Called by the owning LuaScript when a call into Lua returns.
+		 */
+		void closeNativeEvents();
+
+		/**
+		 * @return number of events in the buffer
+		 */
+		int getEventCount() const;
+
+		/**
+		 * Writes the recorded events of one or more tracers as a single Chrome trace_event JSON file.
+		 * @param path the file to write to
+		 * @param tracers the tracers to write, paired with the name of their script
+		 * @param errorState contains the error if the file can't be written
+		 * @return whether the file was written
+		 */
+		static bool writeChromeTrace(const std::string& path, const std::vector<std::pair<const LuaTracer*, std::string>>& tracers, utility::ErrorState& errorState);
+
+	private:
+		static constexpr int sMaxNameLength = 47;
+
+		struct Event
+		{
+			int64 mTimestamp = 0;				///< Steady clock time in nanoseconds
+			uint32 mThread = 0;					///< Id of the recording thread
+			ECategory mCategory = ECategory::Call;
+			char mPhase = 'B';					///< 'B' for begin, 'E' for end
+			char mName[sMaxNameLength + 1] = {};
+		};
+
+		void record(ECategory category, char phase, const char* name);
+
+		bool mRunning = false;
+		std::vector<Event> mEvents;		///< Ring buffer, allocated when recording starts
+		uint64 mWriteIndex = 0;			///< Total number of events recorded
+		int mOpenNativeEvents = 0;		///< C function calls that didn't return yet
+	};
+
+}
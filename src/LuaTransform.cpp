@@ -0,0 +1,266 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "LuaTransform.h"
+#include "LuaBufferView.h"
+
+#include <transformcomponent.h>
+
+#include <new>
+
+namespace nap
+{
+
+	namespace
+	{
+		const char* sTransformMetatable = "nap.LuaTransform";
+		const char* sListMetatable = "nap.LuaTransformList";
+
+
+		TransformComponentInstance& toTransform(lua_State* L)
+		{
+			return *static_cast<LuaTransform*>(luaL_checkudata(L, 1, sTransformMetatable))->mTransform;
+		}
+
+
+		float getFloat(lua_State* L, int index)
+		{
+			return static_cast<float>(luaL_checknumber(L, index));
+		}
+
+
+		int setTranslate(lua_State* L)
+		{
+			toTransform(L).setTranslate(glm::vec3(getFloat(L, 2), getFloat(L, 3), getFloat(L, 4)));
+			return 0;
+		}
+
+
+		int getTranslate(lua_State* L)
+		{
+			const glm::vec3& translate = toTransform(L).getTranslate();
+			lua_pushnumber(L, translate.x);
+			lua_pushnumber(L, translate.y);
+			lua_pushnumber(L, translate.z);
+			return 3;
+		}
+
+
+		int setRotate(lua_State* L)
+		{
+			toTransform(L).setRotate(glm::quat(getFloat(L, 2), getFloat(L, 3), getFloat(L, 4), getFloat(L, 5)));
+			return 0;
+		}
+
+
+		int getRotate(lua_State* L)
+		{
+			const glm::quat& rotate = toTransform(L).getRotate();
+			lua_pushnumber(L, rotate.w);
+			lua_pushnumber(L, rotate.x);
+			lua_pushnumber(L, rotate.y);
+			lua_pushnumber(L, rotate.z);
+			return 4;
+		}
+
+
+		int setScale(lua_State* L)
+		{
+			toTransform(L).setScale(glm::vec3(getFloat(L, 2), getFloat(L, 3), getFloat(L, 4)));
+			return 0;
+		}
+
+
+		int getScale(lua_State* L)
+		{
+			const glm::vec3& scale = toTransform(L).getScale();
+			lua_pushnumber(L, scale.x);
+			lua_pushnumber(L, scale.y);
+			lua_pushnumber(L, scale.z);
+			return 3;
+		}
+
+
+		int setUniformScale(lua_State* L)
+		{
+			toTransform(L).setUniformScale(getFloat(L, 2));
+			return 0;
+		}
+
+
+		int getUniformScale(lua_State* L)
+		{
+			lua_pushnumber(L, toTransform(L).getUniformScale());
+			return 1;
+		}
+
+
+		LuaTransformList& toList(lua_State* L)
+		{
+			return *static_cast<LuaTransformList*>(luaL_checkudata(L, 1, sListMetatable));
+		}
+
+
+		int setTranslates(lua_State* L)
+		{
+			LuaTransformList& list = toList(L);
+			LuaFloatArray values(L, 2, list.mCount * 3, false);
+			TransformComponentInstance** transforms = list.getTransforms();
+			for (int i = 0; i < list.mCount; i++)
+				transforms[i]->setTranslate(glm::vec3(values.get(i * 3), values.get(i * 3 + 1), values.get(i * 3 + 2)));
+			return 0;
+		}
+
+
+		int getTranslates(lua_State* L)
+		{
+			LuaTransformList& list = toList(L);
+			LuaFloatArray values(L, 2, list.mCount * 3, true);
+			TransformComponentInstance** transforms = list.getTransforms();
+			for (int i = 0; i < list.mCount; i++)
+			{
+				const glm::vec3& translate = transforms[i]->getTranslate();
+				values.set(i * 3, translate.x);
+				values.set(i * 3 + 1, translate.y);
+				values.set(i * 3 + 2, translate.z);
+			}
+			return 0;
+		}
+
+
+		int setRotates(lua_State* L)
+		{
+			LuaTransformList& list = toList(L);
+			LuaFloatArray values(L, 2, list.mCount * 4, false);
+			TransformComponentInstance** transforms = list.getTransforms();
+			for (int i = 0; i < list.mCount; i++)
+				transforms[i]->setRotate(glm::quat(values.get(i * 4), values.get(i * 4 + 1), values.get(i * 4 + 2), values.get(i * 4 + 3)));
+			return 0;
+		}
+
+
+		int getRotates(lua_State* L)
+		{
+			LuaTransformList& list = toList(L);
+			LuaFloatArray values(L, 2, list.mCount * 4, true);
+			TransformComponentInstance** transforms = list.getTransforms();
+			for (int i = 0; i < list.mCount; i++)
+			{
+				const glm::quat& rotate = transforms[i]->getRotate();
+				values.set(i * 4, rotate.w);
+				values.set(i * 4 + 1, rotate.x);
+				values.set(i * 4 + 2, rotate.y);
+				values.set(i * 4 + 3, rotate.z);
+			}
+			return 0;
+		}
+
+
+		int setScales(lua_State* L)
+		{
+			LuaTransformList& list = toList(L);
+			LuaFloatArray values(L, 2, list.mCount * 3, false);
+			TransformComponentInstance** transforms = list.getTransforms();
+			for (int i = 0; i < list.mCount; i++)
+				transforms[i]->setScale(glm::vec3(values.get(i * 3), values.get(i * 3 + 1), values.get(i * 3 + 2)));
+			return 0;
+		}
+
+
+		int getScales(lua_State* L)
+		{
+			LuaTransformList& list = toList(L);
+			LuaFloatArray values(L, 2, list.mCount * 3, true);
+			TransformComponentInstance** transforms = list.getTransforms();
+			for (int i = 0; i < list.mCount; i++)
+			{
+				const glm::vec3& scale = transforms[i]->getScale();
+				values.set(i * 3, scale.x);
+				values.set(i * 3 + 1, scale.y);
+				values.set(i * 3 + 2, scale.z);
+			}
+			return 0;
+		}
+
+
+		int length(lua_State* L)
+		{
+			lua_pushinteger(L, toList(L).mCount);
+			return 1;
+		}
+
+
+		/**
+		 * Creates the metatable 'name' when the state doesn't have it yet, with the functions as methods, and sets it on the userdata on top of the stack.
+		 */
+		void setMetatable(lua_State* L, const char* name, const luaL_Reg* methods, const char* hiddenName, lua_CFunction lengthFunction = nullptr)
+		{
+			if (luaL_newmetatable(L, name))
+			{
+				lua_newtable(L);
+				for (const luaL_Reg* method = methods; method->name != nullptr; method++)
+				{
+					lua_pushcfunction(L, method->func);
+					lua_setfield(L, -2, method->name);
+				}
+				lua_setfield(L, -2, "__index");
+				if (lengthFunction != nullptr)
+				{
+					lua_pushcfunction(L, lengthFunction);
+					lua_setfield(L, -2, "__len");
+				}
+				lua_pushstring(L, hiddenName);
+				lua_setfield(L, -2, "__metatable");
+			}
+			lua_setmetatable(L, -2);
+		}
+	}
+
+
+	LuaTransform* LuaTransform::push(lua_State* L, TransformComponentInstance& transform)
+	{
+		static const luaL_Reg methods[] =
+		{
+			{ "setTranslate", &setTranslate },
+			{ "getTranslate", &getTranslate },
+			{ "setRotate", &setRotate },
+			{ "getRotate", &getRotate },
+			{ "setScale", &setScale },
+			{ "getScale", &getScale },
+			{ "setUniformScale", &setUniformScale },
+			{ "getUniformScale", &getUniformScale },
+			{ nullptr, nullptr }
+		};
+
+		auto* handle = new (lua_newuserdata(L, sizeof(LuaTransform))) LuaTransform();
+		handle->mTransform = &transform;
+		setMetatable(L, sTransformMetatable, methods, "LuaTransform");
+		return handle;
+	}
+
+
+	LuaTransformList* LuaTransformList::push(lua_State* L, const std::vector<TransformComponentInstance*>& transforms)
+	{
+		static const luaL_Reg methods[] =
+		{
+			{ "setTranslates", &setTranslates },
+			{ "getTranslates", &getTranslates },
+			{ "setRotates", &setRotates },
+			{ "getRotates", &getRotates },
+			{ "setScales", &setScales },
+			{ "getScales", &getScales },
+			{ nullptr, nullptr }
+		};
+
+		size_t size = sizeof(LuaTransformList) + transforms.size() * sizeof(TransformComponentInstance*);
+		auto* list = new (lua_newuserdata(L, size)) LuaTransformList();
+		list->mCount = static_cast<int>(transforms.size());
+		for (int i = 0; i < list->mCount; i++)
+			list->getTransforms()[i] = transforms[i];
+
+		setMetatable(L, sListMetatable, methods, "LuaTransformList", &length);
+		return list;
+	}
+
+}
@@ -0,0 +1,74 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include "LuaCompat.h"
+
+#include <utility/dllexport.h>
+
+#include <vector>
+
+namespace nap
+{
+
+	class TransformComponentInstance;
+
+	/**
+	 * Userdata that gives a script direct access to a TransformComponentInstance. The values are passed as plain numbers,
+	 * so reading and writing a transform doesn't create vector userdata:
+	 *
+	 *	transform:setTranslate(x, y, z)			local x, y, z = transform:getTranslate()
+	 *	transform:setRotate(w, x, y, z)			local w, x, y, z = transform:getRotate()
+	 *	transform:setScale(x, y, z)				local x, y, z = transform:getScale()
+	 *	transform:setUniformScale(s)			local s = transform:getUniformScale()
+	 *
+	 * The component has to outlive the handle.
+	 * Handles are main-thread-only: they write the component without synchronisation while the main thread may be rendering it.
+	 * LuaScript refuses to give them to asynchronous and real-time scripts.
+	 */
+	struct NAPAPI LuaTransform final
+	{
+		TransformComponentInstance* mTransform = nullptr;
+
+		/**
+		 * Creates a handle to 'transform' and pushes it on the stack of the state.
+		 * @param L the Lua state
+		 * @param transform the component
+		 * @return the handle, which lives as long as Lua keeps a reference to it
+		 */
+		static LuaTransform* push(lua_State* L, TransformComponentInstance& transform);
+	};
+
+
+	/**
+	 * Userdata that gives a script direct access to many TransformComponentInstances at once. The batch functions take and fill
+	 * a flat array of numbers, a Lua table or a LuaBufferView, with 3 values per transform (4 for rotations, in w, x, y, z order):
+	 *
+	 *	transforms:setTranslates(values)		transforms:getTranslates(values)
+	 *	transforms:setRotates(values)			transforms:getRotates(values)
+	 *	transforms:setScales(values)			transforms:getScales(values)
+	 *
+	 * #transforms is the number of transforms. The components have to outlive the list. Main-thread-only, like LuaTransform.
+	 */
+	struct NAPAPI LuaTransformList final
+	{
+		// Aligned for the pointers that follow the list in the same userdata.
+		alignas(void*) int mCount = 0;		///< Number of transforms, stored directly after the list
+
+		/**
+		 * @return the transforms of the list
+		 */
+		TransformComponentInstance** getTransforms() { return reinterpret_cast<TransformComponentInstance**>(this + 1); }
+
+		/**
+		 * Creates a list of 'transforms' and pushes it on the stack of the state. The list and its transforms are a single userdata.
+		 * @param L the Lua state
+		 * @param transforms the components
+		 * @return the list, which lives as long as Lua keeps a reference to it
+		 */
+		static LuaTransformList* push(lua_State* L, const std::vector<TransformComponentInstance*>& transforms);
+	};
+
+}
@@ -0,0 +1,213 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "LuaUniform.h"
+#include "LuaBufferView.h"
+
+#include <new>
+
+namespace nap
+{
+
+	namespace
+	{
+		const char* sUniformMetatable = "nap.LuaUniform";
+		const char* sStructMetatable = "nap.LuaUniformStruct";
+
+
+		/**
+		 * Sets the uniform from 'values', starting at value 'first'.
+		 */
+		template <typename Values>
+		void setValue(const LuaUniform& uniform, const Values& values, int first)
+		{
+			if (uniform.mType == LuaUniform::EType::Vec3)
+				static_cast<UniformVec3Instance*>(uniform.mUniform)->setValue(glm::vec3(values.get(first), values.get(first + 1), values.get(first + 2)));
+			else
+				static_cast<UniformFloatInstance*>(uniform.mUniform)->setValue(values.get(first));
+		}
+
+
+		/**
+		 * Writes the value of the uniform into 'values', starting at value 'first'.
+		 */
+		template <typename Values>
+		void getValue(const LuaUniform& uniform, Values& values, int first)
+		{
+			if (uniform.mType == LuaUniform::EType::Vec3)
+			{
+				const glm::vec3& value = static_cast<UniformVec3Instance*>(uniform.mUniform)->getValue();
+				values.set(first, value.x);
+				values.set(first + 1, value.y);
+				values.set(first + 2, value.z);
+			}
+			else
+			{
+				values.set(first, static_cast<UniformFloatInstance*>(uniform.mUniform)->getValue());
+			}
+		}
+
+
+		/**
+		 * The arguments of a call, read as the values of a uniform.
+		 */
+		struct Arguments
+		{
+			lua_State* L;
+			int mFirstIndex;
+
+			float get(int i) const { return static_cast<float>(luaL_checknumber(L, mFirstIndex + i)); }
+		};
+
+
+		/**
+		 * Values pushed on the stack as the results of a call.
+		 */
+		struct Results
+		{
+			lua_State* L;
+
+			void set(int i, float value) { lua_pushnumber(L, value); }
+		};
+
+
+		int set(lua_State* L)
+		{
+			const auto& uniform = *static_cast<LuaUniform*>(luaL_checkudata(L, 1, sUniformMetatable));
+			setValue(uniform, Arguments{ L, 2 }, 0);
+			return 0;
+		}
+
+
+		int get(lua_State* L)
+		{
+			const auto& uniform = *static_cast<LuaUniform*>(luaL_checkudata(L, 1, sUniformMetatable));
+			Results results{ L };
+			getValue(uniform, results, 0);
+			return uniform.getSize();
+		}
+
+
+		int setStruct(lua_State* L)
+		{
+			auto& uniform_struct = *static_cast<LuaUniformStruct*>(luaL_checkudata(L, 1, sStructMetatable));
+			LuaFloatArray values(L, 2, uniform_struct.mValueCount, false);
+			const LuaUniform* members = uniform_struct.getMembers();
+			for (int i = 0, first = 0; i < uniform_struct.mCount; first += members[i].getSize(), i++)
+				setValue(members[i], values, first);
+			return 0;
+		}
+
+
+		int getStruct(lua_State* L)
+		{
+			auto& uniform_struct = *static_cast<LuaUniformStruct*>(luaL_checkudata(L, 1, sStructMetatable));
+			LuaFloatArray values(L, 2, uniform_struct.mValueCount, true);
+			const LuaUniform* members = uniform_struct.getMembers();
+			for (int i = 0, first = 0; i < uniform_struct.mCount; first += members[i].getSize(), i++)
+				getValue(members[i], values, first);
+			return 0;
+		}
+
+
+		int length(lua_State* L)
+		{
+			lua_pushinteger(L, static_cast<LuaUniformStruct*>(luaL_checkudata(L, 1, sStructMetatable))->mValueCount);
+			return 1;
+		}
+
+
+		/**
+		 * Creates the metatable 'name' when the state doesn't have it yet, with 'set' and 'get' as methods, and sets it on the userdata on top of the stack.
+		 */
+		void setMetatable(lua_State* L, const char* name, lua_CFunction setFunction, lua_CFunction getFunction, const char* hiddenName, lua_CFunction lengthFunction = nullptr)
+		{
+			if (luaL_newmetatable(L, name))
+			{
+				lua_newtable(L);
+				lua_pushcfunction(L, setFunction);
+				lua_setfield(L, -2, "set");
+				lua_pushcfunction(L, getFunction);
+				lua_setfield(L, -2, "get");
+				lua_setfield(L, -2, "__index");
+				if (lengthFunction != nullptr)
+				{
+					lua_pushcfunction(L, lengthFunction);
+					lua_setfield(L, -2, "__len");
+				}
+				lua_pushstring(L, hiddenName);
+				lua_setfield(L, -2, "__metatable");
+			}
+			lua_setmetatable(L, -2);
+		}
+
+
+		LuaUniform* pushUniform(lua_State* L, void* uniform, LuaUniform::EType type)
+		{
+			auto* handle = new (lua_newuserdata(L, sizeof(LuaUniform))) LuaUniform();
+			handle->mUniform = uniform;
+			handle->mType = type;
+			setMetatable(L, sUniformMetatable, &set, &get, "LuaUniform");
+			return handle;
+		}
+	}
+
+
+	LuaUniform* LuaUniform::push(lua_State* L, UniformFloatInstance& uniform)
+	{
+		return pushUniform(L, &uniform, EType::Float);
+	}
+
+
+	LuaUniform* LuaUniform::push(lua_State* L, UniformVec3Instance& uniform)
+	{
+		return pushUniform(L, &uniform, EType::Vec3);
+	}
+
+
+	bool LuaUniformStruct::resolve(UniformStructInstance& uniformStruct, const std::vector<std::string>& names, std::vector<LuaUniform>& outMembers, utility::ErrorState& errorState)
+	{
+		outMembers.clear();
+		outMembers.reserve(names.size());
+		for (const auto& name : names)
+		{
+			// Created from its declaration when it wasn't used yet, with the type the shader declares.
+			UniformInstance* uniform = uniformStruct.getOrCreateUniform<UniformInstance>(name);
+			if (!errorState.check(uniform != nullptr, "uniform '%s' doesn't exist", name.c_str()))
+				return false;
+
+			LuaUniform member;
+			if (uniform->get_type().is_derived_from(RTTI_OF(UniformVec3Instance)))
+			{
+				member.mUniform = static_cast<UniformVec3Instance*>(uniform);
+				member.mType = LuaUniform::EType::Vec3;
+			}
+			else
+			{
+				if (!errorState.check(uniform->get_type().is_derived_from(RTTI_OF(UniformFloatInstance)), "uniform '%s' is not a float or a vec3", name.c_str()))
+					return false;
+				member.mUniform = static_cast<UniformFloatInstance*>(uniform);
+			}
+			outMembers.emplace_back(member);
+		}
+		return true;
+	}
+
+
+	LuaUniformStruct* LuaUniformStruct::push(lua_State* L, const std::vector<LuaUniform>& members)
+	{
+		size_t size = sizeof(LuaUniformStruct) + members.size() * sizeof(LuaUniform);
+		auto* uniform_struct = new (lua_newuserdata(L, size)) LuaUniformStruct();
+		uniform_struct->mCount = static_cast<int>(members.size());
+		for (int i = 0; i < uniform_struct->mCount; i++)
+		{
+			new (uniform_struct->getMembers() + i) LuaUniform(members[i]);
+			uniform_struct->mValueCount += members[i].getSize();
+		}
+
+		setMetatable(L, sStructMetatable, &setStruct, &getStruct, "LuaUniformStruct", &length);
+		return uniform_struct;
+	}
+
+}
@@ -0,0 +1,101 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include "LuaCompat.h"
+
+#include <uniforminstance.h>
+#include <nap/numeric.h>
+#include <utility/dllexport.h>
+
+#include <vector>
+
+namespace nap
+{
+
+	/**
+	 * Userdata that gives a script direct access to a float or vec3 uniform of a material, resolved once in C++ so setting it doesn't look it up by name.
+	 * The values are passed as plain numbers:
+	 *
+	 *	intensity:set(0.5)				local value = intensity:get()
+	 *	color:set(r, g, b)				local r, g, b = color:get()
+	 *
+	 * The uniform has to outlive the handle.
+	 * Handles are main-thread-only: they write the uniform without synchronisation while the main thread may be rendering with it.
+	 * LuaScript refuses to give them to asynchronous and real-time scripts.
+	 */
+	struct NAPAPI LuaUniform final
+	{
+		enum class EType : uint8
+		{
+			Float,
+			Vec3
+		};
+
+		void* mUniform = nullptr;		///< The UniformFloatInstance or UniformVec3Instance
+		EType mType = EType::Float;
+
+		/**
+		 * @return number of floats in the value of the uniform
+		 */
+		int getSize() const { return mType == EType::Vec3 ? 3 : 1; }
+
+		/**
+		 * Creates a handle to a float uniform and pushes it on the stack of the state.
+		 * @param L the Lua state
+		 * @param uniform the uniform
+		 * @return the handle, which lives as long as Lua keeps a reference to it
+		 */
+		static LuaUniform* push(lua_State* L, UniformFloatInstance& uniform);
+
+		/**
+		 * Creates a handle to a vec3 uniform and pushes it on the stack of the state.
+		 * @param L the Lua state
+		 * @param uniform the uniform
+		 * @return the handle, which lives as long as Lua keeps a reference to it
+		 */
+		static LuaUniform* push(lua_State* L, UniformVec3Instance& uniform);
+	};
+
+
+	/**
+	 * Userdata that sets or reads the float and vec3 members of a uniform struct at once, from or into a flat array of numbers:
+	 * a Lua table or a LuaBufferView with the values of the members in order, 1 per float and 3 per vec3.
+	 *
+	 *	colors:set(values)				colors:get(values)
+	 *
+	 * #colors is the number of values. The uniforms have to outlive the handle. Main-thread-only, like LuaUniform.
+	 */
+	struct NAPAPI LuaUniformStruct final
+	{
+		// Aligned for the members that follow the struct in the same userdata.
+		alignas(void*) int mCount = 0;			///< Number of members, stored directly after the struct
+		int mValueCount = 0;	///< Number of floats in the values of all members
+
+		/**
+		 * @return the members of the struct
+		 */
+		LuaUniform* getMembers() { return reinterpret_cast<LuaUniform*>(this + 1); }
+
+		/**
+		 * Resolves the float and vec3 members of a uniform struct by name, creating the uniforms that were not used yet.
+		 * @param uniformStruct the uniform struct, a uniform buffer object of a material
+		 * @param names names of the members
+		 * @param outMembers handles of the members, in the order of their names
+		 * @param errorState contains the error when a member doesn't exist or is not a float or a vec3
+		 * @return whether all members were resolved
+		 */
+		static bool resolve(UniformStructInstance& uniformStruct, const std::vector<std::string>& names, std::vector<LuaUniform>& outMembers, utility::ErrorState& errorState);
+
+		/**
+		 * Creates a handle to the resolved members of a uniform struct and pushes it on the stack of the state.
+		 * @param L the Lua state
+		 * @param members the members, resolved with resolve()
+		 * @return the handle, which lives as long as Lua keeps a reference to it
+		 */
+		static LuaUniformStruct* push(lua_State* L, const std::vector<LuaUniform>& members);
+	};
+
+}
@@ -0,0 +1,71 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "LuaValue.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace nap
+{
+
+	void LuaValue::push(lua_State* L) const
+	{
+		switch (mType)
+		{
+			case EType::Nil:		lua_pushnil(L); break;
+			case EType::Boolean:	lua_pushboolean(L, mBoolean ? 1 : 0); break;
+			case EType::Number:		lua_pushnumber(L, static_cast<lua_Number>(mNumber)); break;
+			case EType::String:		lua_pushlstring(L, mString, mLength); break;
+		}
+	}
+
+
+	LuaValue LuaValue::fromStack(lua_State* L, int index)
+	{
+		switch (lua_type(L, index))
+		{
+			case LUA_TBOOLEAN:
+				return LuaValue(lua_toboolean(L, index) != 0);
+			case LUA_TNUMBER:
+				return LuaValue(static_cast<double>(lua_tonumber(L, index)));
+			case LUA_TSTRING:
+			{
+				LuaValue value;
+				size_t length = 0;
+				const char* string = lua_tolstring(L, index, &length);
+				value.setString(string, length);
+				return value;
+			}
+			default:
+				return LuaValue();
+		}
+	}
+
+
+	bool LuaValue::operator==(const LuaValue& other) const
+	{
+		if (mType != other.mType)
+			return false;
+
+		switch (mType)
+		{
+			case EType::Nil:		return true;
+			case EType::Boolean:	return mBoolean == other.mBoolean;
+			case EType::Number:		return mNumber == other.mNumber;
+			case EType::String:		return mLength == other.mLength && std::memcmp(mString, other.mString, mLength) == 0;
+		}
+		return false;
+	}
+
+
+	void LuaValue::setString(const char* value, size_t length)
+	{
+		mType = EType::String;
+		mLength = static_cast<uint8>(std::min<size_t>(length, sMaxStringLength));
+		std::memcpy(mString, value, mLength);
+		mString[mLength] = '\0';
+	}
+
+}
@@ -0,0 +1,97 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include "LuaCompat.h"
+
+#include <utility/dllexport.h>
+#include <nap/numeric.h>
+
+#include <string>
+
+namespace nap
+{
+
+	/**
+	 * A Lua value that is copied by value, without allocating: nil, a boolean, a number or a short string.
+	 * Used to pass data between threads and Lua states, where a Lua reference can't be used.
+	 * Strings longer than sMaxStringLength are truncated.
+	 */
+	class NAPAPI LuaValue final
+	{
+	public:
+		static constexpr int sMaxStringLength = 31;
+
+		enum class EType : uint8
+		{
+			Nil,
+			Boolean,
+			Number,
+			String
+		};
+
+		LuaValue() = default;
+		LuaValue(bool value) : mType(EType::Boolean), mBoolean(value) { }
+		LuaValue(double value) : mType(EType::Number), mNumber(value) { }
+		LuaValue(float value) : LuaValue(static_cast<double>(value)) { }
+		LuaValue(int value) : LuaValue(static_cast<double>(value)) { }
+		LuaValue(const char* value) { setString(value, std::char_traits<char>::length(value)); }
+		LuaValue(const std::string& value) { setString(value.data(), value.size()); }
+
+		/**
+		 * @return the type of the value
+		 */
+		EType getType() const { return mType; }
+
+		/**
+		 * @return whether the value is nil
+		 */
+		bool isNil() const { return mType == EType::Nil; }
+
+		/**
+		 * @return the boolean, false unless the value is true
+		 */
+		bool toBoolean() const { return mType == EType::Boolean && mBoolean; }
+
+		/**
+		 * @return the number, 0 if the value is not a number
+		 */
+		double toNumber() const { return mType == EType::Number ? mNumber : 0.0; }
+
+		/**
+		 * @return the string, empty if the value is not a string
+		 */
+		const char* toString() const { return mType == EType::String ? mString : ""; }
+
+		/**
+		 * Pushes the value onto the stack of a Lua state.
+		 */
+		void push(lua_State* L) const;
+
+		/**
+		 * Reads the value at 'index' of the stack. Types that can't be copied by value are read as nil.
+		 * @param L the Lua state
+		 * @param index stack index of the value
+		 * @return the value
+		 */
+		static LuaValue fromStack(lua_State* L, int index);
+
+		bool operator==(const LuaValue& other) const;
+		bool operator!=(const LuaValue& other) const { return !(*this == other); }
+
+	private:
+		void setString(const char* value, size_t length);
+
+		EType mType = EType::Nil;
+		uint8 mLength = 0;
+		union
+		{
+			bool mBoolean;
+			double mNumber;
+			char mString[sMaxStringLength + 1];
+		};
+	};
+
+}
@@ -0,0 +1,119 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <cerrno>
+	#include <cstring>
+#endif
+
+namespace nap
+{
+
+	MappedFile::~MappedFile()
+	{
+		close();
+	}
+
+
+	bool MappedFile::open(const std::string& path, utility::ErrorState& errorState)
+	{
+		close();
+
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (!errorState.check(file != INVALID_HANDLE_VALUE, "Unable to open file: %s", path.c_str()))
+			return false;
+		mFileHandle = file;
+
+		LARGE_INTEGER size;
+		if (!errorState.check(GetFileSizeEx(file, &size) != 0, "Unable to get size of file: %s", path.c_str()))
+		{
+			close();
+			return false;
+		}
+
+		// Empty files can't be mapped, they simply have no contents.
+		mSize = static_cast<size_t>(size.QuadPart);
+		if (mSize == 0)
+			return true;
+
+		mMappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!errorState.check(mMappingHandle != nullptr, "Unable to map file: %s", path.c_str()))
+		{
+			close();
+			return false;
+		}
+
+		mData = static_cast<const char*>(MapViewOfFile(mMappingHandle, FILE_MAP_READ, 0, 0, 0));
+		if (!errorState.check(mData != nullptr, "Unable to map file: %s", path.c_str()))
+		{
+			close();
+			return false;
+		}
+#else
+		int file = ::open(path.c_str(), O_RDONLY);
+		if (!errorState.check(file >= 0, "Unable to open file: %s (%s)", path.c_str(), std::strerror(errno)))
+			return false;
+
+		struct stat info;
+		if (!errorState.check(fstat(file, &info) == 0, "Unable to get size of file: %s (%s)", path.c_str(), std::strerror(errno)))
+		{
+			::close(file);
+			return false;
+		}
+
+		// Empty files can't be mapped, they simply have no contents.
+		mSize = static_cast<size_t>(info.st_size);
+		if (mSize == 0)
+		{
+			::close(file);
+			return true;
+		}
+
+		// The mapping stays valid after the descriptor is closed.
+		void* data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, file, 0);
+		::close(file);
+		if (!errorState.check(data != MAP_FAILED, "Unable to map file: %s (%s)", path.c_str(), std::strerror(errno)))
+		{
+			mSize = 0;
+			return false;
+		}
+
+		// The file is parsed front to back exactly once.
+		madvise(data, mSize, MADV_SEQUENTIAL);
+		mData = static_cast<const char*>(data);
+#endif
+		return true;
+	}
+
+
+	void MappedFile::close()
+	{
+#ifdef _WIN32
+		if (mData != nullptr)
+			UnmapViewOfFile(mData);
+		if (mMappingHandle != nullptr)
+			CloseHandle(mMappingHandle);
+		if (mFileHandle != nullptr)
+			CloseHandle(mFileHandle);
+		mMappingHandle = nullptr;
+		mFileHandle = nullptr;
+#else
+		if (mData != nullptr)
+			munmap(const_cast<char*>(mData), mSize);
+#endif
+		mData = nullptr;
+		mSize = 0;
+	}
+
+}
@@ -0,0 +1,60 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <utility/dllexport.h>
+#include <utility/errorstate.h>
+
+#include <string>
+
+namespace nap
+{
+
+	/**
+	 * Read-only memory mapping of a file on disk.
+	 * The mapping is released when the object is destroyed.
+	 */
+	class NAPAPI MappedFile final
+	{
+	public:
+		MappedFile() = default;
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		/**
+		 * Maps the file at the given path into memory. Any previous mapping is released first.
+		 * @param path path to the file
+		 * @param errorState contains the error if the file can't be mapped
+		 * @return whether the file was mapped
+		 */
+		bool open(const std::string& path, utility::ErrorState& errorState);
+
+		/**
+		 * Releases the mapping.
+		 */
+		void close();
+
+		/**
+		 * @return the mapped file contents, nullptr if the file is empty or not mapped
+		 */
+		const char* getData() const { return mData; }
+
+		/**
+		 * @return the size of the mapped file in bytes
+		 */
+		size_t getSize() const { return mSize; }
+
+	private:
+		const char* mData = nullptr;
+		size_t mSize = 0;
+#ifdef _WIN32
+		void* mFileHandle = nullptr;
+		void* mMappingHandle = nullptr;
+#endif
+	};
+
+}